@@ -40,6 +40,21 @@ filter "platforms:Win64"
     }
     linkoptions { "/ignore:4099" }
 
+filter "system:linux"
+    platforms { "Linux64" }
+
+filter "platforms:Linux64"
+    defines { "OS_LINUX" }
+    includedirs "src"
+    architecture "x64"
+    cdialect "gnu11"
+    disablewarnings {
+        "unused-parameter",
+        "missing-field-initializers",
+        "multichar",
+    }
+    links { "m", "pthread" }
+
 filter "configurations:Debug"
     defines { "DEBUG_MODE" }
     symbols "On"
@@ -48,7 +63,24 @@ filter "configurations:Release"
     defines { "RELEASE_MODE" }
     optimize "On"
 
+-- Win32 windowed frontend
 project "rasterizer"
     kind "ConsoleApp"
     targetname "rasterizer"
-    files { "src/**.h", "src/**.c" }
\ No newline at end of file
+    removeplatforms { "Linux64" }
+    files { "src/**.h", "src/**.c" }
+    removefiles { "src/main_headless.c", "src/main_bench.c" }
+
+-- Platform-neutral frontend rendering into a memory framebuffer
+project "headless"
+    kind "ConsoleApp"
+    targetname "rasterizer_headless"
+    files { "src/**.h", "src/**.c" }
+    removefiles { "src/main.c", "src/main_bench.c" }
+
+-- Renders a fixed frame sequence and reports frame time statistics
+project "bench"
+    kind "ConsoleApp"
+    targetname "rasterizer_bench"
+    files { "src/**.h", "src/**.c" }
+    removefiles { "src/main.c", "src/main_headless.c" }
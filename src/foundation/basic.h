@@ -74,6 +74,13 @@ typedef struct Time_Stamp {
 // Static array count
 #define ARRAY_COUNT(a) (sizeof(a) / sizeof(a[0]))
 
+// Storage with one instance per thread
+#if defined(OS_WINDOWS)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
 // Static string hashing
 #define STRHASH(x) (x)
 #define STATIC_HASH(s, v) STRHASH(sizeof("" s "") > 0 ? v : v)
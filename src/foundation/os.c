@@ -0,0 +1,58 @@
+#include "os.h"
+
+#if defined(OS_WINDOWS)
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+Time_Stamp os_time_now()
+{
+    LARGE_INTEGER pc;
+    QueryPerformanceCounter(&pc);
+    Time_Stamp result;
+    result.opaque = pc.QuadPart;
+    return result;
+}
+
+double os_time_delta(Time_Stamp to, Time_Stamp from)
+{
+    int64_t delta = to.opaque - from.opaque;
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    return (double)delta / (double)freq.QuadPart;
+}
+
+uint32_t os_num_cpus()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (uint32_t)info.dwNumberOfProcessors;
+}
+
+#else
+
+#include <time.h>
+#include <unistd.h>
+
+Time_Stamp os_time_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    Time_Stamp result;
+    result.opaque = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    return result;
+}
+
+double os_time_delta(Time_Stamp to, Time_Stamp from)
+{
+    int64_t delta = to.opaque - from.opaque;
+    return (double)delta / 1e9;
+}
+
+uint32_t os_num_cpus()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (uint32_t)n : 1;
+}
+
+#endif
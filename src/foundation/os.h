@@ -0,0 +1,11 @@
+#pragma once
+#include "basic.h"
+
+// Current value of the high resolution monotonic clock
+Time_Stamp os_time_now();
+
+// Seconds elapsed between two time stamps
+double os_time_delta(Time_Stamp to, Time_Stamp from);
+
+// Number of logical processors available to the process
+uint32_t os_num_cpus();
@@ -0,0 +1,191 @@
+#include "task.h"
+
+#if defined(OS_WINDOWS)
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE Condition;
+typedef HANDLE Thread;
+
+#define mutex_init(m)           InitializeCriticalSection(m)
+#define mutex_destroy(m)        DeleteCriticalSection(m)
+#define mutex_lock(m)           EnterCriticalSection(m)
+#define mutex_unlock(m)         LeaveCriticalSection(m)
+#define condition_init(c)       InitializeConditionVariable(c)
+#define condition_destroy(c)
+#define condition_wait(c, m)    SleepConditionVariableCS(c, m, INFINITE)
+#define condition_broadcast(c)  WakeAllConditionVariable(c)
+#define atomic_fetch_add_u32(p, v) ((uint32_t)InterlockedExchangeAdd((volatile LONG *)(p), (LONG)(v)))
+
+#else
+
+#include <pthread.h>
+
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Condition;
+typedef pthread_t Thread;
+
+#define mutex_init(m)           pthread_mutex_init(m, 0)
+#define mutex_destroy(m)        pthread_mutex_destroy(m)
+#define mutex_lock(m)           pthread_mutex_lock(m)
+#define mutex_unlock(m)         pthread_mutex_unlock(m)
+#define condition_init(c)       pthread_cond_init(c, 0)
+#define condition_destroy(c)    pthread_cond_destroy(c)
+#define condition_wait(c, m)    pthread_cond_wait(c, m)
+#define condition_broadcast(c)  pthread_cond_broadcast(c)
+#define atomic_fetch_add_u32(p, v) __atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+
+#endif
+
+// The currently executing `task_parallel_for` call
+typedef struct Task_Batch {
+    Task_Func func;
+    void *user_data;
+    uint32_t count;
+    volatile uint32_t next;
+} Task_Batch;
+
+static struct Task_System {
+    Thread threads[MAX_NUM_WORKER_THREADS];
+    uint32_t num_workers;
+    Mutex mutex;
+    Condition wake;
+    Condition done;
+    Task_Batch batch;
+    // Incremented for every new batch
+    uint64_t generation;
+    // Number of workers holding a reference to `batch`
+    uint32_t num_active;
+    bool quit;
+} task_system;
+
+static void run_batch(Task_Batch *batch)
+{
+    for (;;) {
+        uint32_t i = atomic_fetch_add_u32(&batch->next, 1);
+        if (i >= batch->count)
+            break;
+        batch->func(batch->user_data, i);
+    }
+}
+
+static void worker_loop()
+{
+    struct Task_System *ts = &task_system;
+    uint64_t seen_generation = 0;
+
+    mutex_lock(&ts->mutex);
+    for (;;) {
+        while (!ts->quit && ts->generation == seen_generation)
+            condition_wait(&ts->wake, &ts->mutex);
+        if (ts->quit)
+            break;
+
+        seen_generation = ts->generation;
+        ++ts->num_active;
+        mutex_unlock(&ts->mutex);
+
+        run_batch(&ts->batch);
+
+        mutex_lock(&ts->mutex);
+        if (--ts->num_active == 0)
+            condition_broadcast(&ts->done);
+    }
+    mutex_unlock(&ts->mutex);
+}
+
+#if defined(OS_WINDOWS)
+static DWORD WINAPI worker_entry(LPVOID param)
+{
+    worker_loop();
+    return 0;
+}
+#else
+static void *worker_entry(void *param)
+{
+    worker_loop();
+    return 0;
+}
+#endif
+
+void task_system_init(uint32_t num_workers)
+{
+    struct Task_System *ts = &task_system;
+    ts->num_workers = c_min(num_workers, MAX_NUM_WORKER_THREADS);
+    ts->generation = 0;
+    ts->num_active = 0;
+    ts->quit = false;
+    mutex_init(&ts->mutex);
+    condition_init(&ts->wake);
+    condition_init(&ts->done);
+
+    for (uint32_t i = 0; i < ts->num_workers; ++i) {
+#if defined(OS_WINDOWS)
+        ts->threads[i] = CreateThread(0, 0, worker_entry, 0, 0, 0);
+#else
+        pthread_create(&ts->threads[i], 0, worker_entry, 0);
+#endif
+    }
+}
+
+void task_system_shutdown()
+{
+    struct Task_System *ts = &task_system;
+    mutex_lock(&ts->mutex);
+    ts->quit = true;
+    condition_broadcast(&ts->wake);
+    mutex_unlock(&ts->mutex);
+
+    for (uint32_t i = 0; i < ts->num_workers; ++i) {
+#if defined(OS_WINDOWS)
+        WaitForSingleObject(ts->threads[i], INFINITE);
+        CloseHandle(ts->threads[i]);
+#else
+        pthread_join(ts->threads[i], 0);
+#endif
+    }
+
+    condition_destroy(&ts->done);
+    condition_destroy(&ts->wake);
+    mutex_destroy(&ts->mutex);
+    ts->num_workers = 0;
+}
+
+uint32_t task_system_num_threads()
+{
+    return task_system.num_workers + 1;
+}
+
+void task_parallel_for(Task_Func func, void *user_data, uint32_t count)
+{
+    struct Task_System *ts = &task_system;
+    if (ts->num_workers == 0 || count <= 1) {
+        for (uint32_t i = 0; i < count; ++i)
+            func(user_data, i);
+        return;
+    }
+
+    mutex_lock(&ts->mutex);
+    // Workers still draining the previous batch must let go of it before it is reused
+    while (ts->num_active > 0)
+        condition_wait(&ts->done, &ts->mutex);
+    ts->batch = (Task_Batch) {
+        .func = func,
+        .user_data = user_data,
+        .count = count,
+        .next = 0,
+    };
+    ++ts->generation;
+    condition_broadcast(&ts->wake);
+    mutex_unlock(&ts->mutex);
+
+    run_batch(&ts->batch);
+
+    // All indices have been claimed, wait for the ones still running
+    mutex_lock(&ts->mutex);
+    while (ts->num_active > 0)
+        condition_wait(&ts->done, &ts->mutex);
+    mutex_unlock(&ts->mutex);
+}
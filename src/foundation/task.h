@@ -0,0 +1,19 @@
+#pragma once
+#include "basic.h"
+
+#define MAX_NUM_WORKER_THREADS (63)
+
+typedef void (*Task_Func)(void *user_data, uint32_t index);
+
+// Start `num_workers` background threads, the thread calling `task_parallel_for` 
+// participates as well. With zero workers all tasks run on the calling thread.
+void task_system_init(uint32_t num_workers);
+
+// Stop and join all worker threads
+void task_system_shutdown();
+
+// Number of threads executing tasks, including the calling thread
+uint32_t task_system_num_threads();
+
+// Run `func` for every index in [0, count) and block until all calls are done
+void task_parallel_for(Task_Func func, void *user_data, uint32_t count);
@@ -1,57 +1,183 @@
 #include "gfx_api.h"
 #include "foundation/array.h"
 #include "foundation/math.h"
+#include "foundation/task.h"
 #include "mesh.h"
+#include <assert.h>
 #include <float.h>
 #include <limits.h>
+#include <stddef.h>
 
+// Vertex shader outputs are handled as a flat array of floats
+#define NUM_VARYINGS ((int)(sizeof(Vertex) / sizeof(float)))
+STATIC_ASSERT(sizeof(Vertex) == NUM_VARYINGS * sizeof(float));
+STATIC_ASSERT(sizeof(Vertex_Batch) == NUM_VARYINGS * VERTEX_SHADER_BATCH_WIDTH * sizeof(float));
+
+// Floats of `Vertex` covered by each `Varying_Flags` bit
+static const struct {
+    uint32_t offset;
+    uint32_t count;
+} varying_layout[] = {
+    { offsetof(Vertex, position) / sizeof(float), 3 },
+    { offsetof(Vertex, uv) / sizeof(float), 2 },
+    { offsetof(Vertex, normal) / sizeof(float), 3 },
+    { offsetof(Vertex, tangent) / sizeof(float), 3 },
+};
+
+// Vertex after the vertex shader, its varyings are stored separately
 typedef struct Projected_Vertex {
+    Vec4 clip_pos;
     Vec2 screen_pos;
     float depth;
     float inv_w;
-    Vec3 position;
-    Vec2 uv;
-    Vec3 normal;
-    Vec3 tangent;
-    float _pad;
 } Projected_Vertex;
 
+// Projected vertex of a vertex buffer index, valid during the draw call whose generation it carries
+typedef struct Vertex_Cache_Entry {
+    uint32_t generation;
+    uint32_t index;
+} Vertex_Cache_Entry;
+
+// Triangle referencing three projected vertices, output of the clipping stage
+typedef struct Triangle {
+    uint32_t v[3];
+} Triangle;
+
+// Visibility buffer value of pixels not covered by any triangle
+#define NO_TRIANGLE (0xffffffffu)
+
+// Half-extent of the guard band in pixels. Only triangles reaching outside of it are
+// clipped against the side planes, everything else is clipped by the bounding box.
+#define GUARD_BAND_SIZE (8192)
+
+// Screen is split into square tiles that are rasterized in parallel. Each tile of the
+// color, depth and visibility buffers is contiguous in memory with rows of `TILE_SIZE` pixels.
+#define TILE_SIZE (64)
+#define TILE_PIXELS (TILE_SIZE * TILE_SIZE)
+
+typedef struct Bounding_Box {
+    int x0, y0;
+    int x1, y1;
+} Bounding_Box;
+
+typedef struct Tile {
+    // Inclusive pixel bounds of the tile
+    Bounding_Box bounds;
+    // Indices of triangles overlapping the tile
+    uint32_t *triangles;
+    uint64_t num_pixels_shaded;
+} Tile;
+
+// Pixels of a row loaded by one SSE register
+#define SPAN_WIDTH (4)
+
+// Pixels are rasterized and shaded in 2x2 quads, one pixel per SSE lane
+#define QUAD_SIZE (2)
+#define QUAD_LANES (QUAD_SIZE * QUAD_SIZE)
+
+// Size of the pixel blocks tracked by the hierarchical depth buffer
+#define HIZ_BLOCK_SIZE (8)
+
 struct Graphics_Context {
     int width;
     int height;
+    // Buffers are made of whole tiles, `num_tiles_x` * `num_tiles_y` * `TILE_PIXELS` pixels
     uint32_t *color_buf;
     float *depth_buf;
+    // Index of the visible triangle per pixel in deferred mode
+    uint32_t *vis_buf;
+    // Conservative farthest depth of every `HIZ_BLOCK_SIZE` pixel block
+    float *hiz_buf;
+    int hiz_stride;
+    int hiz_height;
     Vertex_Shader vertex_shader;
+    Batch_Vertex_Shader batch_vertex_shader;
     Pixel_Shader pixel_shader;
+    Depth_Shader depth_shader;
+    Quad_Shader quad_shader;
+    // Offsets in `Vertex` of the varyings read by the pixel shader
+    uint32_t varying_offsets[NUM_VARYINGS];
+    int num_varyings;
+    Cull_Mode cull_mode;
+    Render_Mode render_mode;
     Mat44 viewport_transform;
+    // Guard band planes in clip space
+    float guard_band_x;
+    float guard_band_y;
     // Raw data
     Allocator *allocator;
     Buffer *buffers;
     Texture *textures;
     // Bindings
     const void *uniform_bindings[MAX_NUM_UNIFORM_BLOCKS];
-    Texture *texture_bindings[MAX_NUM_TEXTURES];
+    const Texture *texture_bindings[MAX_NUM_TEXTURES];
+    Sampler sampler_bindings[MAX_NUM_TEXTURES];
     // Runtime
+    Vertex_Cache_Entry *vertex_cache;
+    uint32_t vertex_cache_generation;
+    // Vertex buffer index of every projected vertex transformed by the vertex shader
+    uint32_t *vertex_sources;
     Projected_Vertex *projected_vertices;
+    // Live varyings of every projected vertex, packed with a stride of `num_varyings`
+    float *varyings;
+    Triangle *triangles;
+    Tile *tiles;
+    int num_tiles_x;
+    int num_tiles_y;
+    Gfx_Stats stats;
 } *ctx = &(struct Graphics_Context) {
     0
 };
 
+// Offset in the tiled buffers of the start of row `y` of the tile containing pixel `x`, 
+// minus `x` rounded down to the tile. Indexing it with any `x` of that tile gives the pixel.
+static inline int tile_row_offset(int x, int y)
+{
+    const int tile = x / TILE_SIZE + (y / TILE_SIZE) * ctx->num_tiles_x;
+    return tile * TILE_PIXELS + (y % TILE_SIZE) * TILE_SIZE - (x & ~(TILE_SIZE - 1));
+}
+
 static void init(int width, int height)
 {
     ctx->allocator = system_allocator;
 
-    const int n = width * height;
+    ctx->num_tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    ctx->num_tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    const int n = ctx->num_tiles_x * ctx->num_tiles_y * TILE_PIXELS;
     ctx->color_buf = c_alloc(ctx->allocator, n * sizeof(*ctx->color_buf));
     ctx->depth_buf = c_alloc(ctx->allocator, n * sizeof(*ctx->depth_buf));
+    ctx->vis_buf = c_alloc(ctx->allocator, n * sizeof(*ctx->vis_buf));
     ctx->width = width;
     ctx->height = height;
+    ctx->stats = (Gfx_Stats) { 0 };
 
     for (int i = 0; i < n; ++i) {
         ctx->color_buf[i] = 0;
         ctx->depth_buf[i] = FLT_MAX;
     }
 
+    ctx->hiz_stride = (width + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE;
+    ctx->hiz_height = (height + HIZ_BLOCK_SIZE - 1) / HIZ_BLOCK_SIZE;
+    const int num_blocks = ctx->hiz_stride * ctx->hiz_height;
+    ctx->hiz_buf = c_alloc(ctx->allocator, num_blocks * sizeof(*ctx->hiz_buf));
+    for (int i = 0; i < num_blocks; ++i) {
+        ctx->hiz_buf[i] = FLT_MAX;
+    }
+
+    for (int ty = 0; ty < ctx->num_tiles_y; ++ty) {
+        for (int tx = 0; tx < ctx->num_tiles_x; ++tx) {
+            Tile tile = {
+                .bounds = {
+                    .x0 = tx * TILE_SIZE,
+                    .y0 = ty * TILE_SIZE,
+                    .x1 = c_min((tx + 1) * TILE_SIZE, width) - 1,
+                    .y1 = c_min((ty + 1) * TILE_SIZE, height) - 1,
+                },
+            };
+            array_push(ctx->tiles, tile, ctx->allocator);
+        }
+    }
+
     float ww = (float)width * 0.5f;
     float hh = (float)height * 0.5f;
     ctx->viewport_transform = (Mat44) {
@@ -60,6 +186,8 @@ static void init(int width, int height)
         0, 0, 1, 0,
         ww, hh, 0, 1,
     };
+    ctx->guard_band_x = 1.f + GUARD_BAND_SIZE / ww;
+    ctx->guard_band_y = 1.f + GUARD_BAND_SIZE / hh;
 }
 
 static void shutdown()
@@ -69,21 +197,65 @@ static void shutdown()
         c_free(a, it->data, it->size);
     }
     for (Texture *it = ctx->textures; it != array_end(ctx->textures); ++it) {
-        c_free(a, it->data, it->width * it->height * it->channels);
+        c_free(a, it->data, it->size);
     }
     array_free(ctx->buffers, a);
     array_free(ctx->textures, a);
+    array_free(ctx->vertex_cache, a);
+    array_free(ctx->vertex_sources, a);
     array_free(ctx->projected_vertices, a);
+    array_free(ctx->varyings, a);
+    array_free(ctx->triangles, a);
+    for (Tile *it = ctx->tiles; it != array_end(ctx->tiles); ++it) {
+        array_free(it->triangles, a);
+    }
+    array_free(ctx->tiles, a);
 
-    int num_pixels = ctx->width * ctx->height;
+    int num_pixels = ctx->num_tiles_x * ctx->num_tiles_y * TILE_PIXELS;
     c_free(a, ctx->color_buf, num_pixels * sizeof(*ctx->color_buf));
     c_free(a, ctx->depth_buf, num_pixels * sizeof(*ctx->depth_buf));
+    c_free(a, ctx->vis_buf, num_pixels * sizeof(*ctx->vis_buf));
+    c_free(a, ctx->hiz_buf, ctx->hiz_stride * ctx->hiz_height * sizeof(*ctx->hiz_buf));
 }
 
-static void bind_shaders(Vertex_Shader vs, Pixel_Shader ps)
+static void bind_shaders(Vertex_Shader vs, Pixel_Shader ps, uint32_t varyings)
 {
     ctx->vertex_shader = vs;
     ctx->pixel_shader = ps;
+
+    ctx->num_varyings = 0;
+    for (uint32_t i = 0; i < sizeof(varying_layout) / sizeof(varying_layout[0]); ++i) {
+        if ((varyings & (1 << i)) == 0)
+            continue;
+        for (uint32_t j = 0; j < varying_layout[i].count; ++j) {
+            ctx->varying_offsets[ctx->num_varyings++] = varying_layout[i].offset + j;
+        }
+    }
+}
+
+static void bind_batch_vertex_shader(Batch_Vertex_Shader vs)
+{
+    ctx->batch_vertex_shader = vs;
+}
+
+static void bind_quad_shader(Quad_Shader qs)
+{
+    ctx->quad_shader = qs;
+}
+
+static void bind_depth_shader(Depth_Shader ds)
+{
+    ctx->depth_shader = ds;
+}
+
+static void set_cull_mode(Cull_Mode mode)
+{
+    ctx->cull_mode = mode;
+}
+
+static void set_render_mode(Render_Mode mode)
+{
+    ctx->render_mode = mode;
 }
 
 static void bind_uniform_block(uint32_t slot, gfx_id id)
@@ -102,17 +274,103 @@ static void bind_texture(uint32_t slot, gfx_id id)
     }
 }
 
-static gfx_id create_texture(const void *data, int width, int height, int channels)
+static void bind_sampler(uint32_t slot, Sampler sampler)
+{
+    if (slot < MAX_NUM_TEXTURES)
+        ctx->sampler_bindings[slot] = sampler;
+}
+
+// Expands a source texel of an uncompressed format to RGBA
+static uint32_t make_texel(const uint8_t *src, Texture_Format format)
+{
+    switch (format) {
+    case TEXTURE_FORMAT_R8: return src[0] * 0x010101u | 0xff000000u;
+    case TEXTURE_FORMAT_RG8: return src[0] | src[1] << 8 | 0xff000000u;
+    case TEXTURE_FORMAT_RGB8: return src[0] | src[1] << 8 | src[2] << 16 | 0xff000000u;
+    default: return src[0] | src[1] << 8 | src[2] << 16 | (uint32_t)src[3] << 24;
+    }
+}
+
+// Box filters `src` down to the next smaller mip level `dst`, odd sizes repeat the last
+// row or column
+static void downsample_level(Texture_Level *dst, const Texture_Level *src)
+{
+    for (int y = 0; y < dst->height; ++y) {
+        const int y0 = c_min(2 * y, src->height - 1);
+        const int y1 = c_min(2 * y + 1, src->height - 1);
+        for (int x = 0; x < dst->width; ++x) {
+            const int x0 = c_min(2 * x, src->width - 1);
+            const int x1 = c_min(2 * x + 1, src->width - 1);
+            const uint32_t in[4] = {
+                src->texels[texel_index(src, x0, y0)],
+                src->texels[texel_index(src, x1, y0)],
+                src->texels[texel_index(src, x0, y1)],
+                src->texels[texel_index(src, x1, y1)],
+            };
+            uint32_t out = 0;
+            for (int shift = 0; shift < 32; shift += 8) {
+                uint32_t sum = 2;
+                for (int i = 0; i < 4; ++i)
+                    sum += (in[i] >> shift) & 0xff;
+                out |= (sum / 4) << shift;
+            }
+            dst->texels[texel_index(dst, x, y)] = out;
+        }
+    }
+}
+
+static gfx_id create_texture(const void *data, int width, int height, Texture_Format format)
 {
-    uint64_t bytes = width * height * channels;
-    void *mem = c_alloc(ctx->allocator, bytes);
-    memcpy(mem, data, bytes);
     Texture texture = {
-        .data = mem,
         .width = width,
         .height = height,
-        .channels = channels,
+        .format = format,
+        .power_of_two = (width & (width - 1)) == 0 && (height & (height - 1)) == 0,
     };
+    const int block_bytes = texture_block_bytes(format);
+    uint64_t level_sizes[MAX_NUM_TEXTURE_LEVELS];
+    int w = width;
+    int h = height;
+    for (;;) {
+        const int blocks_x = (w + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+        const int blocks_y = (h + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+        const uint64_t bytes_per_block = block_bytes ? (uint64_t)block_bytes : TEXTURE_BLOCK_TEXELS * sizeof(uint32_t);
+        level_sizes[texture.num_levels] = (uint64_t)blocks_x * blocks_y * bytes_per_block;
+        texture.size += level_sizes[texture.num_levels];
+        texture.levels[texture.num_levels++] = (Texture_Level) { .width = w, .height = h, .blocks_x = blocks_x };
+        if ((w == 1 && h == 1) || texture.num_levels == MAX_NUM_TEXTURE_LEVELS)
+            break;
+        w = c_max(w / 2, 1);
+        h = c_max(h / 2, 1);
+    }
+
+    texture.data = c_alloc(ctx->allocator, texture.size);
+    uint8_t *level_data = texture.data;
+    for (int i = 0; i < texture.num_levels; ++i) {
+        texture.levels[i].blocks = level_data;
+        level_data += level_sizes[i];
+    }
+
+    if (block_bytes) {
+        // Compressed blocks are kept as they are
+        memcpy(texture.data, data, texture.size);
+    } else {
+        // Padding texels of partial blocks are never sampled, zero them to keep the contents deterministic
+        memset(texture.data, 0, texture.size);
+        const int channels = format - TEXTURE_FORMAT_R8 + 1;
+        const uint8_t *src = data;
+        Texture_Level *level = &texture.levels[0];
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                level->texels[texel_index(level, x, y)] = make_texel(src, format);
+                src += channels;
+            }
+        }
+        for (int i = 1; i < texture.num_levels; ++i) {
+            downsample_level(&texture.levels[i], &texture.levels[i - 1]);
+        }
+    }
+
     array_push(ctx->textures, texture, ctx->allocator);
     return (gfx_id)array_size(ctx->textures);
 }
@@ -138,134 +396,863 @@ static void update_buffer(gfx_id id, const void *data, uint64_t size, uint64_t o
         memcpy((uint8_t *)buf->data + offset, data, size);
 }
 
-static Vec3 calc_barycentric_coords(int x, int y, const Vec2 *p)
+// Screen space plane equation `e(x, y) = a * x + b * y + c`, used for everything
+// interpolated across a triangle
+typedef struct Edge {
+    float a, b, c;
+} Edge;
+
+static inline float edge_eval(Edge e, float x, float y)
 {
-    const Vec3 a = (Vec3) {
-        .x = p[2].x - p[0].x,
-        .y = p[1].x - p[0].x,
-        .z = p[0].x - x,
-    };
-    const Vec3 b = (Vec3) {
-        .x = p[2].y - p[0].y,
-        .y = p[1].y - p[0].y,
-        .z = p[0].y - y,
+    return e.a * x + e.b * y + e.c;
+}
+
+// Screen positions are snapped to a fixed point grid with `SUBPIXEL_BITS` of 
+// fractional precision so coverage can be evaluated exactly with integer math
+#define SUBPIXEL_BITS (4)
+#define SUBPIXEL_STEPS (1 << SUBPIXEL_BITS)
+
+typedef struct Fixed_Point {
+    int32_t x, y;
+} Fixed_Point;
+
+static inline Fixed_Point snap_to_subpixel(Vec2 p)
+{
+    return (Fixed_Point) {
+        .x = (int32_t)floorf(p.x * SUBPIXEL_STEPS + 0.5f),
+        .y = (int32_t)floorf(p.y * SUBPIXEL_STEPS + 0.5f),
     };
-    const Vec3 u = vec3_cross(a, b);
-    const float s = 1.0f / u.z;
-    return (Vec3) {
-        s * (u.z - (u.x + u.y)),
-        s * u.y,
-        s * u.x,
+}
+
+// Twice the signed area of a snapped triangle, screen space y points down so 
+// clockwise is positive
+static inline int64_t fixed_triangle_area(const Fixed_Point *p)
+{
+    return (int64_t)(p[1].x - p[0].x) * (p[2].y - p[0].y) - (int64_t)(p[1].y - p[0].y) * (p[2].x - p[0].x);
+}
+
+// Pixels whose center lies within the bounds of a snapped triangle clamped to `clip`,
+// empty if x1 < x0 or y1 < y0
+static inline Bounding_Box triangle_bounds(const Fixed_Point *points, Bounding_Box clip)
+{
+    int32_t min_x = INT32_MAX, min_y = INT32_MAX;
+    int32_t max_x = INT32_MIN, max_y = INT32_MIN;
+    for (int i = 0; i < 3; ++i) {
+        min_x = c_min(min_x, points[i].x);
+        min_y = c_min(min_y, points[i].y);
+        max_x = c_max(max_x, points[i].x);
+        max_y = c_max(max_y, points[i].y);
+    }
+
+    // Pixel centers are at half-pixel offsets
+    const int32_t half = SUBPIXEL_STEPS / 2;
+    Bounding_Box bb = {
+        .x0 = (min_x - half + SUBPIXEL_STEPS - 1) >> SUBPIXEL_BITS,
+        .y0 = (min_y - half + SUBPIXEL_STEPS - 1) >> SUBPIXEL_BITS,
+        .x1 = (max_x - half) >> SUBPIXEL_BITS,
+        .y1 = (max_y - half) >> SUBPIXEL_BITS,
     };
+    bb.x0 = c_max(bb.x0, clip.x0);
+    bb.y0 = c_max(bb.y0, clip.y0);
+    bb.x1 = c_min(bb.x1, clip.x1);
+    bb.y1 = c_min(bb.y1, clip.y1);
+    return bb;
 }
 
-static inline void vec3_interpolate_3(Vec3 *out, const Vec3 p0, const Vec3 p1, const Vec3 p2, Vec3 uvw)
+// Farthest depth value within the block at `x`, `y`
+static float calc_block_max_depth(int x, int y)
+{
+    const int x1 = c_min(x + HIZ_BLOCK_SIZE, ctx->width);
+    const int y1 = c_min(y + HIZ_BLOCK_SIZE, ctx->height);
+    __m128 max_depth = _mm_setzero_ps();
+    for (int j = y; j < y1; ++j) {
+        const float *depth_row = ctx->depth_buf + tile_row_offset(x, j);
+        int i = x;
+        for (; i + SPAN_WIDTH <= x1; i += SPAN_WIDTH) {
+            max_depth = _mm_max_ps(max_depth, _mm_loadu_ps(depth_row + i));
+        }
+        for (; i < x1; ++i) {
+            max_depth = _mm_max_ss(max_depth, _mm_load_ss(depth_row + i));
+        }
+    }
+    max_depth = _mm_max_ps(max_depth, _mm_shuffle_ps(max_depth, max_depth, _MM_SHUFFLE(1, 0, 3, 2)));
+    max_depth = _mm_max_ps(max_depth, _mm_shuffle_ps(max_depth, max_depth, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(max_depth);
+}
+
+// Integer edge equation in subpixel units evaluated at pixel centers, `e(x, y) = a * x + b * y + c`
+// for pixel coordinates `x`, `y`. Pixels are covered where the function is non-negative.
+typedef struct Fixed_Edge {
+    int32_t a, b;
+    int64_t c;
+} Fixed_Edge;
+
+static inline Fixed_Edge make_fixed_edge(Fixed_Point p0, Fixed_Point p1)
 {
-    *out = (Vec3) {
-        .x = p0.x * uvw.x + p1.x * uvw.y + p2.x * uvw.z,
-        .y = p0.y * uvw.x + p1.y * uvw.y + p2.y * uvw.z,
-        .z = p0.z * uvw.x + p1.z * uvw.y + p2.z * uvw.z,
+    const int32_t a = p0.y - p1.y;
+    const int32_t b = p1.x - p0.x;
+    const int64_t c = (int64_t)p0.x * p1.y - (int64_t)p0.y * p1.x;
+
+    // Move the origin to the center of pixel (0, 0) and step by whole pixels
+    const int32_t half = SUBPIXEL_STEPS / 2;
+    return (Fixed_Edge) {
+        .a = a * SUBPIXEL_STEPS,
+        .b = b * SUBPIXEL_STEPS,
+        .c = c + (int64_t)a * half + (int64_t)b * half,
     };
 }
 
-static inline void vec2_interpolate_3(Vec2 *out, Vec2 p0, Vec2 p1, Vec2 p2, Vec3 uvw)
+static inline int64_t fixed_edge_eval(Fixed_Edge e, int x, int y)
+{
+    return (int64_t)e.a * x + (int64_t)e.b * y + e.c;
+}
+
+// Per-triangle state shared by rasterization and shading
+typedef struct Triangle_Setup {
+    // Bounds clamped to the tile
+    Bounding_Box bb;
+    // Coverage edges including the fill rule bias
+    Fixed_Edge fixed_edges[3];
+    // Depth is linear in screen space and interpolated without perspective correction
+    Edge depth_plane;
+    // Interpolated depth never goes below the nearest vertex
+    float min_depth;
+    // Live varyings are interpolated as a/w alongside 1/w and perspective corrected per pixel
+    Edge inv_w_plane;
+    Edge varying_planes[NUM_VARYINGS];
+} Triangle_Setup;
+
+// Plane equation interpolating `values` given at the vertices across the triangle
+static inline Edge make_plane(const Fixed_Edge *edges, double inv_area, const float *values)
 {
-    *out = (Vec2) {
-        .x = p0.x * uvw.x + p1.x * uvw.y + p2.x * uvw.z,
-        .y = p0.y * uvw.x + p1.y * uvw.y + p2.y * uvw.z,
+    return (Edge) {
+        .a = (float)((edges[0].a * (double)values[0] + edges[1].a * (double)values[1] + edges[2].a * (double)values[2]) * inv_area),
+        .b = (float)((edges[0].b * (double)values[0] + edges[1].b * (double)values[1] + edges[2].b * (double)values[2]) * inv_area),
+        .c = (float)((edges[0].c * (double)values[0] + edges[1].c * (double)values[1] + edges[2].c * (double)values[2]) * inv_area),
     };
 }
 
-static void rasterize_triangle(
-    const Projected_Vertex v0, const Projected_Vertex v1, const Projected_Vertex v2, 
-    const Shader_Bindings *bindings)
+static bool setup_triangle(Triangle_Setup *ts, const Triangle *tri, Bounding_Box clip)
 {
-    struct Bounding_Box {
-        int x0, y0;
-        int x1, y1;
-    } bb = {
-        INT_MAX, INT_MAX,
-        INT_MIN, INT_MIN,
+    const Projected_Vertex *v[3] = {
+        &ctx->projected_vertices[tri->v[0]],
+        &ctx->projected_vertices[tri->v[1]],
+        &ctx->projected_vertices[tri->v[2]],
     };
+    Fixed_Point points[3] = {
+        snap_to_subpixel(v[0]->screen_pos),
+        snap_to_subpixel(v[1]->screen_pos),
+        snap_to_subpixel(v[2]->screen_pos),
+    };
+    int64_t area = fixed_triangle_area(points);
+    if (area == 0)
+        return false;
+
+    // Normalize to clockwise winding so the inside of every edge is positive
+    if (area < 0) {
+        const Projected_Vertex *tmp_v = v[1];
+        v[1] = v[2];
+        v[2] = tmp_v;
+        const Fixed_Point tmp_p = points[1];
+        points[1] = points[2];
+        points[2] = tmp_p;
+        area = -area;
+    }
+
+    ts->bb = triangle_bounds(points, clip);
+    if (ts->bb.x1 < ts->bb.x0 || ts->bb.y1 < ts->bb.y0)
+        return false;
 
-    const Vec2 points[3] = {
-        v0.screen_pos, v1.screen_pos, v2.screen_pos,
+    const Fixed_Edge edges[3] = {
+        make_fixed_edge(points[1], points[2]),
+        make_fixed_edge(points[2], points[0]),
+        make_fixed_edge(points[0], points[1]),
     };
     for (int i = 0; i < 3; ++i) {
-        bb.x0 = c_max(0, c_min(bb.x0, (int)points[i].x));
-        bb.y0 = c_max(0, c_min(bb.y0, (int)points[i].y));
-        bb.x1 = c_min(ctx->width - 1, c_max(bb.x1, (int)points[i].x));
-        bb.y1 = c_min(ctx->height - 1, c_max(bb.y1, (int)points[i].y));
+        // Top-left fill rule: pixel centers exactly on an edge are only covered if it 
+        // is a top edge (horizontal, pointing right) or a left edge (pointing up), so 
+        // pixels on edges shared by two triangles are rasterized exactly once
+        const bool top_left = edges[i].a > 0 || (edges[i].a == 0 && edges[i].b > 0);
+        ts->fixed_edges[i] = edges[i];
+        ts->fixed_edges[i].c -= top_left ? 0 : 1;
     }
 
-    if (bb.x1 < bb.x0 || bb.y1 < bb.y0)
+    // The edges scaled by the reciprocal area yield barycentric weights, so the planes 
+    // are consistent with the snapped positions used for coverage
+    const double inv_area = 1.0 / (double)area;
+    const float depth[3] = { v[0]->depth, v[1]->depth, v[2]->depth };
+    const float inv_w[3] = { v[0]->inv_w, v[1]->inv_w, v[2]->inv_w };
+    ts->depth_plane = make_plane(edges, inv_area, depth);
+    ts->min_depth = c_min(depth[0], c_min(depth[1], depth[2]));
+    ts->inv_w_plane = make_plane(edges, inv_area, inv_w);
+
+    const float *varyings[3] = {
+        &ctx->varyings[(v[0] - ctx->projected_vertices) * ctx->num_varyings],
+        &ctx->varyings[(v[1] - ctx->projected_vertices) * ctx->num_varyings],
+        &ctx->varyings[(v[2] - ctx->projected_vertices) * ctx->num_varyings],
+    };
+    for (int i = 0; i < ctx->num_varyings; ++i) {
+        const float values[3] = {
+            varyings[0][i] * inv_w[0],
+            varyings[1][i] * inv_w[1],
+            varyings[2][i] * inv_w[2],
+        };
+        ts->varying_planes[i] = make_plane(edges, inv_area, values);
+    }
+    return true;
+}
+
+// Perspective corrected attributes at pixel `x`, `y`, varyings not read by the pixel
+// shader are left untouched
+static inline void interpolate_vertex(Vertex *vert, const Triangle_Setup *ts, float x, float y)
+{
+    const float w = 1.f / edge_eval(ts->inv_w_plane, x, y);
+    float *out = (float *)vert;
+    for (int i = 0; i < ctx->num_varyings; ++i) {
+        out[ctx->varying_offsets[i]] = edge_eval(ts->varying_planes[i], x, y) * w;
+    }
+}
+
+// Attribute planes evaluated across a quad, advanced to the next quad with adds
+typedef struct Quad_Planes {
+    __m128 inv_w;
+    __m128 varyings[NUM_VARYINGS];
+} Quad_Planes;
+
+static inline void quad_planes_init(Quad_Planes *qp, Quad_Planes *step, const Triangle_Setup *ts, float x, float y)
+{
+    const __m128 quad_x = _mm_setr_ps(0, 1, 0, 1);
+    const __m128 quad_y = _mm_setr_ps(0, 0, 1, 1);
+    const __m128 quad_size = _mm_set1_ps(QUAD_SIZE);
+    const Edge w = ts->inv_w_plane;
+    qp->inv_w = _mm_add_ps(_mm_set1_ps(edge_eval(w, x, y)), 
+        _mm_add_ps(_mm_mul_ps(_mm_set1_ps(w.a), quad_x), _mm_mul_ps(_mm_set1_ps(w.b), quad_y)));
+    step->inv_w = _mm_mul_ps(_mm_set1_ps(w.a), quad_size);
+    for (int i = 0; i < ctx->num_varyings; ++i) {
+        const Edge p = ts->varying_planes[i];
+        qp->varyings[i] = _mm_add_ps(_mm_set1_ps(edge_eval(p, x, y)), 
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.a), quad_x), _mm_mul_ps(_mm_set1_ps(p.b), quad_y)));
+        step->varyings[i] = _mm_mul_ps(_mm_set1_ps(p.a), quad_size);
+    }
+}
+
+static inline void quad_planes_step(Quad_Planes *qp, const Quad_Planes *step)
+{
+    qp->inv_w = _mm_add_ps(qp->inv_w, step->inv_w);
+    for (int i = 0; i < ctx->num_varyings; ++i) {
+        qp->varyings[i] = _mm_add_ps(qp->varyings[i], step->varyings[i]);
+    }
+}
+
+// Perspective correct the quad, `out[i][lane]` is varying `i` of pixel `lane`
+static inline void quad_planes_resolve(float (*out)[QUAD_LANES], const Quad_Planes *qp)
+{
+    const __m128 w = _mm_div_ps(_mm_set1_ps(1.f), qp->inv_w);
+    for (int i = 0; i < ctx->num_varyings; ++i) {
+        _mm_storeu_ps(out[i], _mm_mul_ps(qp->varyings[i], w));
+    }
+}
+
+static inline void load_quad_vertex(Vertex *vert, float (*varyings)[QUAD_LANES], int lane)
+{
+    float *out = (float *)vert;
+    for (int i = 0; i < ctx->num_varyings; ++i) {
+        out[ctx->varying_offsets[i]] = varyings[i][lane];
+    }
+}
+
+// Two pixels from each of two consecutive rows
+static inline __m128 load_quad(const void *row0, const void *row1)
+{
+    return _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)row0), (const __m64 *)row1);
+}
+
+static inline void store_quad(void *row0, void *row1, __m128 v)
+{
+    _mm_storel_pi((__m64 *)row0, v);
+    _mm_storeh_pi((__m64 *)row1, v);
+}
+
+static inline uint32_t pack_color(Vec3 color)
+{
+    uint8_t r = (uint8_t)c_min(color.x * 255, 255);
+    uint8_t g = (uint8_t)c_min(color.y * 255, 255);
+    uint8_t b = (uint8_t)c_min(color.z * 255, 255);
+    return r << 16 | g << 8 | b;
+}
+
+// Shade the lanes of `quad` set in `quad->mask`, writing packed colors to `out`. Quad
+// shaders run once for the whole quad, pixel shaders once per lane.
+static inline void shade_quad(const Pixel_Quad *quad, uint32_t *out, const Shader_Bindings *bindings)
+{
+    if (ctx->quad_shader) {
+        Vec3 colors[QUAD_LANES];
+        ctx->quad_shader(quad, colors, bindings);
+        for (int lane = 0; lane < QUAD_LANES; ++lane) {
+            if (quad->mask & (1 << lane))
+                out[lane] = pack_color(colors[lane]);
+        }
         return;
+    }
+    for (int lane = 0; lane < QUAD_LANES; ++lane) {
+        if (quad->mask & (1 << lane))
+            out[lane] = pack_color(ctx->pixel_shader(&quad->in[lane], bindings));
+    }
+}
 
-    for (int x = bb.x0; x <= bb.x1; ++x) {
-        for (int y = bb.y0; y <= bb.y1; ++y) {
-            Vec3 uvw = calc_barycentric_coords(x, y, points);
-            if (uvw.x < 0 || uvw.y < 0 || uvw.z < 0)
-                continue;
+typedef enum Raster_Pass {
+    // Depth test and write, shade passing fragments
+    RASTER_PASS_SHADE,
+    // Depth test and write, store the triangle index in the visibility buffer
+    RASTER_PASS_VISIBILITY,
+    // Depth test and write only
+    RASTER_PASS_DEPTH,
+    // Shade fragments whose depth equals the depth buffer, without writing depth
+    RASTER_PASS_SHADE_EQUAL,
+} Raster_Pass;
 
-            // Perspective correction factor
-            float pc = 1.f / (uvw.x * v0.inv_w + uvw.y * v1.inv_w + uvw.z * v2.inv_w);
-            uvw = vec3_mul(uvw, pc);
+// Lanes of `depth` passing the depth test against `old_depth`
+static inline __m128 depth_test(__m128 depth, __m128 old_depth, bool equal)
+{
+    const __m128 in_range = _mm_cmpge_ps(depth, _mm_setzero_ps());
+    return _mm_and_ps(in_range, equal ? _mm_cmpeq_ps(depth, old_depth) : _mm_cmplt_ps(depth, old_depth));
+}
 
-            // Calculate depth value
-            float depth = uvw.x * v0.depth + uvw.y * v1.depth + uvw.z * v2.depth;
-            if (depth < 0)
+static void rasterize_triangle(Tile *tile, const Triangle_Setup *ts, uint32_t triangle_index,
+    Raster_Pass pass, const Shader_Bindings *bindings)
+{
+    const Bounding_Box bb = ts->bb;
+    const bool depth_equal = pass == RASTER_PASS_SHADE_EQUAL;
+    // A depth shader may move fragments anywhere, so depth can only be tested after it ran
+    const bool late_z = ctx->depth_shader != 0;
+    // Quad shaders may take derivatives across the quad, so every lane needs its varyings
+    const bool helper_lanes = ctx->quad_shader != 0;
+
+    const __m128 quad_x = _mm_setr_ps(0, 1, 0, 1);
+    const __m128 quad_y = _mm_setr_ps(0, 0, 1, 1);
+    const __m128i quad_xi = _mm_setr_epi32(0, 1, 0, 1);
+    const __m128i quad_yi = _mm_setr_epi32(0, 0, 1, 1);
+    const __m128 min_depth = _mm_set1_ps(ts->min_depth);
+    const __m128 z_lanes = _mm_add_ps(
+        _mm_mul_ps(_mm_set1_ps(ts->depth_plane.a), quad_x), _mm_mul_ps(_mm_set1_ps(ts->depth_plane.b), quad_y));
+    const __m128 z_step = _mm_set1_ps(ts->depth_plane.a * QUAD_SIZE);
+    const __m128i triangle_id = _mm_set1_epi32((int)triangle_index);
+    const __m128i all_ones = _mm_set1_epi32(-1);
+    // Lanes outside of the bounds are masked, the comparisons are strict so widen by one
+    const __m128i quad_min_x = _mm_set1_epi32(bb.x0 - 1);
+    const __m128i quad_max_x = _mm_set1_epi32(bb.x1 + 1);
+    const __m128i quad_min_y = _mm_set1_epi32(bb.y0 - 1);
+    const __m128i quad_max_y = _mm_set1_epi32(bb.y1 + 1);
+    // Varyings the pixel shader does not read are never written and stay zero
+    Pixel_Quad quad = { 0 };
+
+    // Walk the bounding box in blocks which can be rejected against the hierarchical 
+    // depth buffer, and within a block in rows of 2x2 quads. Blocks and quads start 
+    // aligned and tiles are a multiple of the block size, so neither ever leaves the tile.
+    const int block_x0 = bb.x0 & ~(HIZ_BLOCK_SIZE - 1);
+    const int block_y0 = bb.y0 & ~(HIZ_BLOCK_SIZE - 1);
+    for (int by = block_y0; by <= bb.y1; by += HIZ_BLOCK_SIZE) {
+        for (int bx = block_x0; bx <= bb.x1; bx += HIZ_BLOCK_SIZE) {
+            float *hiz = &ctx->hiz_buf[(by / HIZ_BLOCK_SIZE) * ctx->hiz_stride + bx / HIZ_BLOCK_SIZE];
+            if (!late_z && (depth_equal ? ts->min_depth > *hiz : ts->min_depth >= *hiz))
                 continue;
 
-            // Check against depth buffer
-            int idx = x + y * ctx->width;
-            if (depth < ctx->depth_buf[idx]) {
-                ctx->depth_buf[idx] = depth;
-
-                // Interpolate attributes
-                Vertex v;
-                vec3_interpolate_3(&v.position, v0.position, v1.position, v2.position, uvw);
-                vec2_interpolate_3(&v.uv, v0.uv, v1.uv, v2.uv, uvw);
-                vec3_interpolate_3(&v.normal, v0.normal, v1.normal, v2.normal, uvw);
-                vec3_interpolate_3(&v.tangent, v0.tangent, v1.tangent, v2.tangent, uvw);
-
-                // Calculate final output color
-                Vec3 out_color = ctx->pixel_shader(&v, bindings);
-                uint8_t r = (uint8_t)c_min(out_color.x * 255, 255);
-                uint8_t g = (uint8_t)c_min(out_color.y * 255, 255);
-                uint8_t b = (uint8_t)c_min(out_color.z * 255, 255);
-                ctx->color_buf[idx] = r << 16 | g << 8 | b;
+            // Skip blocks entirely outside of one of the edges. Edges containing the whole 
+            // block need no per-pixel test, the others are stepped in 32-bit integers: 
+            // their values within the block are bounded by the block extent.
+            bool outside = false;
+            int32_t edge_row[3], edge_dx[3], edge_dy[3];
+            for (int i = 0; i < 3; ++i) {
+                const Fixed_Edge e = ts->fixed_edges[i];
+                const int64_t value = fixed_edge_eval(e, bx, by);
+                const int64_t max_value = value 
+                    + (int64_t)c_max(e.a, 0) * (HIZ_BLOCK_SIZE - 1) + (int64_t)c_max(e.b, 0) * (HIZ_BLOCK_SIZE - 1);
+                const int64_t min_value = value 
+                    + (int64_t)c_min(e.a, 0) * (HIZ_BLOCK_SIZE - 1) + (int64_t)c_min(e.b, 0) * (HIZ_BLOCK_SIZE - 1);
+                outside |= max_value < 0;
+                const bool partial = min_value < 0;
+                edge_row[i] = partial ? (int32_t)value : 0;
+                edge_dx[i] = partial ? e.a : 0;
+                edge_dy[i] = partial ? e.b : 0;
             }
+            if (outside)
+                continue;
+
+            const __m128i edge_step0 = _mm_set1_epi32(edge_dx[0] * QUAD_SIZE);
+            const __m128i edge_step1 = _mm_set1_epi32(edge_dx[1] * QUAD_SIZE);
+            const __m128i edge_step2 = _mm_set1_epi32(edge_dx[2] * QUAD_SIZE);
+            const __m128i edge_lanes0 = _mm_setr_epi32(0, edge_dx[0], edge_dy[0], edge_dx[0] + edge_dy[0]);
+            const __m128i edge_lanes1 = _mm_setr_epi32(0, edge_dx[1], edge_dy[1], edge_dx[1] + edge_dy[1]);
+            const __m128i edge_lanes2 = _mm_setr_epi32(0, edge_dx[2], edge_dy[2], edge_dx[2] + edge_dy[2]);
+
+            bool written = false;
+            const int y0 = c_max(by, bb.y0) & ~(QUAD_SIZE - 1);
+            const int y1 = c_min(by + HIZ_BLOCK_SIZE - 1, bb.y1);
+            const int x1 = c_min(bx + HIZ_BLOCK_SIZE - 1, bb.x1);
+            for (int y = y0; y <= y1; y += QUAD_SIZE) {
+                // Tiles have an even number of rows, so the second row always exists
+                const int rows[QUAD_SIZE] = { tile_row_offset(bx, y), tile_row_offset(bx, y + 1) };
+                uint32_t *color_rows[QUAD_SIZE] = { ctx->color_buf + rows[0], ctx->color_buf + rows[1] };
+                float *depth_rows[QUAD_SIZE] = { ctx->depth_buf + rows[0], ctx->depth_buf + rows[1] };
+                uint32_t *vis_rows[QUAD_SIZE] = { ctx->vis_buf + rows[0], ctx->vis_buf + rows[1] };
+                const __m128i ys = _mm_add_epi32(_mm_set1_epi32(y), quad_yi);
+                const __m128i in_rows = _mm_and_si128(_mm_cmpgt_epi32(ys, quad_min_y), _mm_cmplt_epi32(ys, quad_max_y));
+                __m128i e0 = _mm_add_epi32(_mm_set1_epi32(edge_row[0] + edge_dy[0] * (y - by)), edge_lanes0);
+                __m128i e1 = _mm_add_epi32(_mm_set1_epi32(edge_row[1] + edge_dy[1] * (y - by)), edge_lanes1);
+                __m128i e2 = _mm_add_epi32(_mm_set1_epi32(edge_row[2] + edge_dy[2] * (y - by)), edge_lanes2);
+                __m128 z = _mm_add_ps(_mm_set1_ps(edge_eval(ts->depth_plane, (float)bx, (float)y)), z_lanes);
+                Quad_Planes planes, planes_step;
+                int planes_x = INT_MIN;
+
+                for (int x = bx; x <= x1; x += QUAD_SIZE,
+                        e0 = _mm_add_epi32(e0, edge_step0), e1 = _mm_add_epi32(e1, edge_step1), e2 = _mm_add_epi32(e2, edge_step2),
+                        z = _mm_add_ps(z, z_step)) {
+                    // Coverage mask, covered where no edge function has its sign bit set
+                    const __m128i xs = _mm_add_epi32(_mm_set1_epi32(x), quad_xi);
+                    const __m128i in_bounds = _mm_and_si128(in_rows, 
+                        _mm_and_si128(_mm_cmpgt_epi32(xs, quad_min_x), _mm_cmplt_epi32(xs, quad_max_x)));
+                    const __m128i inside = _mm_cmpgt_epi32(_mm_or_si128(_mm_or_si128(e0, e1), e2), all_ones);
+                    __m128 mask = _mm_castsi128_ps(_mm_and_si128(inside, in_bounds));
+                    if (_mm_movemask_ps(mask) == 0)
+                        continue;
+
+                    // Early depth test on the screen space depth, occluded fragments are
+                    // rejected before any perspective correction. Clamped so rounding 
+                    // never takes it below the Hi-Z reject bound.
+                    __m128 depth = _mm_max_ps(min_depth, z);
+                    const __m128 old_depth = load_quad(depth_rows[0] + x, depth_rows[1] + x);
+                    if (!late_z) {
+                        mask = _mm_and_ps(mask, depth_test(depth, old_depth, depth_equal));
+                        if (_mm_movemask_ps(mask) == 0)
+                            continue;
+                    }
+
+                    // Attribute planes are only evaluated for quads with surviving fragments, 
+                    // then stepped from there along the row
+                    if (planes_x == INT_MIN)
+                        quad_planes_init(&planes, &planes_step, ts, (float)x, (float)y);
+                    for (; planes_x != INT_MIN && planes_x < x; planes_x += QUAD_SIZE)
+                        quad_planes_step(&planes, &planes_step);
+                    planes_x = x;
+
+                    float varyings[NUM_VARYINGS][QUAD_LANES];
+                    quad_planes_resolve(varyings, &planes);
+
+                    // Late depth test on the output of the depth shader
+                    int bits = _mm_movemask_ps(mask);
+                    if (late_z) {
+                        float depths[QUAD_LANES];
+                        _mm_storeu_ps(depths, depth);
+                        for (int lane = 0; lane < QUAD_LANES; ++lane) {
+                            if ((bits & (1 << lane)) == 0)
+                                continue;
+                            load_quad_vertex(&quad.in[lane], varyings, lane);
+                            depths[lane] = ctx->depth_shader(&quad.in[lane], depths[lane], bindings);
+                        }
+                        depth = _mm_loadu_ps(depths);
+                        mask = _mm_and_ps(mask, depth_test(depth, old_depth, depth_equal));
+                        bits = _mm_movemask_ps(mask);
+                        if (bits == 0)
+                            continue;
+                    }
+
+                    if (!depth_equal) {
+                        const __m128 new_depth = _mm_or_ps(_mm_and_ps(mask, depth), _mm_andnot_ps(mask, old_depth));
+                        store_quad(depth_rows[0] + x, depth_rows[1] + x, new_depth);
+                        written = true;
+                    }
+                    if (pass == RASTER_PASS_DEPTH)
+                        continue;
+
+                    if (pass == RASTER_PASS_VISIBILITY) {
+                        const __m128i mask_i = _mm_castps_si128(mask);
+                        const __m128i old_id = _mm_castps_si128(load_quad(vis_rows[0] + x, vis_rows[1] + x));
+                        const __m128i id = _mm_or_si128(_mm_and_si128(mask_i, triangle_id), _mm_andnot_si128(mask_i, old_id));
+                        store_quad(vis_rows[0] + x, vis_rows[1] + x, _mm_castsi128_ps(id));
+                        continue;
+                    }
+
+                    // Late-Z already loaded the covered lanes
+                    for (int lane = 0; lane < QUAD_LANES; ++lane) {
+                        const bool covered = bits & (1 << lane);
+                        if (covered ? !late_z : helper_lanes)
+                            load_quad_vertex(&quad.in[lane], varyings, lane);
+                    }
+                    quad.mask = (uint32_t)bits;
+                    uint32_t colors[QUAD_LANES];
+                    shade_quad(&quad, colors, bindings);
+                    for (int lane = 0; lane < QUAD_LANES; ++lane) {
+                        if ((bits & (1 << lane)) == 0)
+                            continue;
+                        color_rows[lane / QUAD_SIZE][x + lane % QUAD_SIZE] = colors[lane];
+                        ++tile->num_pixels_shaded;
+                    }
+                }
+            }
+
+            if (written)
+                *hiz = calc_block_max_depth(bx, by);
         }
     }
 }
 
-static void process_vertices(Projected_Vertex **output, 
-    const Vertex *vertices, uint32_t num_vertices, const Shader_Bindings *bindings)
+// Shade every pixel of the tile covered by a triangle in the visibility buffer. Quads 
+// are shaded once for each distinct triangle covering them.
+static void shade_visibility(Tile *tile, const Shader_Bindings *bindings)
 {
+    Triangle_Setup ts;
+    uint32_t setup_index = NO_TRIANGLE;
+    Pixel_Quad quad = { 0 };
+
+    const Bounding_Box bb = tile->bounds;
+    for (int y = bb.y0; y <= bb.y1; y += QUAD_SIZE) {
+        const int rows[QUAD_SIZE] = { tile_row_offset(bb.x0, y), tile_row_offset(bb.x0, y + 1) };
+        uint32_t *color_rows[QUAD_SIZE] = { ctx->color_buf + rows[0], ctx->color_buf + rows[1] };
+        const uint32_t *vis_rows[QUAD_SIZE] = { ctx->vis_buf + rows[0], ctx->vis_buf + rows[1] };
+        for (int x = bb.x0; x <= bb.x1; x += QUAD_SIZE) {
+            uint32_t indices[QUAD_LANES];
+            uint32_t remaining = 0;
+            for (int lane = 0; lane < QUAD_LANES; ++lane) {
+                const int px = x + lane % QUAD_SIZE;
+                const int py = y + lane / QUAD_SIZE;
+                indices[lane] = vis_rows[lane / QUAD_SIZE][px];
+                if (px <= bb.x1 && py <= bb.y1 && indices[lane] != NO_TRIANGLE)
+                    remaining |= 1 << lane;
+            }
+
+            while (remaining) {
+                int first_lane = 0;
+                while ((remaining & (1 << first_lane)) == 0)
+                    ++first_lane;
+                const uint32_t index = indices[first_lane];
+                quad.mask = 0;
+                for (int lane = first_lane; lane < QUAD_LANES; ++lane) {
+                    if ((remaining & (1 << lane)) && indices[lane] == index)
+                        quad.mask |= 1 << lane;
+                }
+                remaining &= ~quad.mask;
+
+                // Neighbouring pixels mostly belong to the same triangle
+                if (index != setup_index) {
+                    setup_triangle(&ts, &ctx->triangles[index], bb);
+                    setup_index = index;
+                }
+
+                for (int lane = 0; lane < QUAD_LANES; ++lane) {
+                    if (ctx->quad_shader || (quad.mask & (1 << lane)))
+                        interpolate_vertex(&quad.in[lane], &ts, (float)(x + lane % QUAD_SIZE), (float)(y + lane / QUAD_SIZE));
+                }
+                uint32_t colors[QUAD_LANES];
+                shade_quad(&quad, colors, bindings);
+                for (int lane = 0; lane < QUAD_LANES; ++lane) {
+                    if ((quad.mask & (1 << lane)) == 0)
+                        continue;
+                    color_rows[lane / QUAD_SIZE][x + lane % QUAD_SIZE] = colors[lane];
+                    ++tile->num_pixels_shaded;
+                }
+            }
+        }
+    }
+}
+
+// Number of vertices transformed by a single task, a multiple of the vertex shader batch width
+#define VERTEX_BATCH_SIZE (1024)
+
+// Perspective divide and viewport transform of the clip space position
+static inline void project_vertex(Projected_Vertex *v)
+{
+    const float inv_w = 1.f / v->clip_pos.w;
+    const Vec4 ndc_pos = vec4_mul(v->clip_pos, inv_w);
+    const Vec4 screen_pos = mat44_transform_vec4(&ctx->viewport_transform, ndc_pos);
+    v->screen_pos = (Vec2) { screen_pos.x, screen_pos.y };
+    v->depth = ndc_pos.z;
+    v->inv_w = inv_w;
+}
+
+typedef struct Vertex_Job {
+    Projected_Vertex *output;
+    float *varyings;
+    const Vertex *vertices;
+    // Vertex buffer index of every output vertex
+    const uint32_t *sources;
+    uint32_t num_vertices;
+    const Shader_Bindings *bindings;
+} Vertex_Job;
+
+static void process_vertex_batch(void *user_data, uint32_t batch_index)
+{
+    const Vertex_Job *job = user_data;
+    const uint32_t first = batch_index * VERTEX_BATCH_SIZE;
+    const uint32_t last = c_min(first + VERTEX_BATCH_SIZE, job->num_vertices);
+
+    const int num_varyings = ctx->num_varyings;
+    if (ctx->batch_vertex_shader) {
+        for (uint32_t i = first; i < last; i += VERTEX_SHADER_BATCH_WIDTH) {
+            const uint32_t n = c_min(VERTEX_SHADER_BATCH_WIDTH, last - i);
+
+            // Transpose to structure of arrays, padding a partial batch with its last vertex
+            Vertex_Batch in, out;
+            Vec4_Batch clip_pos;
+            float (*in_floats)[VERTEX_SHADER_BATCH_WIDTH] = (float (*)[VERTEX_SHADER_BATCH_WIDTH])&in;
+            for (uint32_t lane = 0; lane < VERTEX_SHADER_BATCH_WIDTH; ++lane) {
+                const float *src = (const float *)&job->vertices[job->sources[i + c_min(lane, n - 1)]];
+                for (int j = 0; j < NUM_VARYINGS; ++j) {
+                    in_floats[j][lane] = src[j];
+                }
+            }
+            ctx->batch_vertex_shader(&in, &out, &clip_pos, job->bindings);
+
+            const float (*out_floats)[VERTEX_SHADER_BATCH_WIDTH] = (const float (*)[VERTEX_SHADER_BATCH_WIDTH])&out;
+            for (uint32_t lane = 0; lane < n; ++lane) {
+                Projected_Vertex *v = &job->output[i + lane];
+                v->clip_pos = make_vec4(clip_pos.x[lane], clip_pos.y[lane], clip_pos.z[lane], clip_pos.w[lane]);
+                project_vertex(v);
+
+                float *dst = &job->varyings[(i + lane) * num_varyings];
+                for (int j = 0; j < num_varyings; ++j) {
+                    dst[j] = out_floats[ctx->varying_offsets[j]][lane];
+                }
+            }
+        }
+        return;
+    }
+
+    for (uint32_t i = first; i < last; ++i) {
+        Projected_Vertex *v = &job->output[i];
+        Vertex out;
+        v->clip_pos = ctx->vertex_shader(&job->vertices[job->sources[i]], &out, job->bindings);
+        project_vertex(v);
+
+        // Keep only the varyings the pixel shader reads
+        const float *src = (const float *)&out;
+        float *dst = &job->varyings[i * num_varyings];
+        for (int j = 0; j < num_varyings; ++j) {
+            dst[j] = src[ctx->varying_offsets[j]];
+        }
+    }
+}
+
+// Transform the vertices at `sources` in the vertex buffer into consecutive outputs
+static void process_vertices(Projected_Vertex **output, float **varyings,
+    const Vertex *vertices, const uint32_t *sources, uint32_t num_vertices, const Shader_Bindings *bindings)
+{
+    // Size the outputs up front so batches can write their slice directly
+    const uint32_t num_varyings = num_vertices * ctx->num_varyings;
     array_reset(*output);
     array_ensure(*output, num_vertices, ctx->allocator);
+    if (*output)
+        array_header(*output)->size = num_vertices;
+    array_reset(*varyings);
+    array_ensure(*varyings, num_varyings, ctx->allocator);
+    if (*varyings)
+        array_header(*varyings)->size = num_varyings;
 
-    for (uint32_t i = 0; i < num_vertices; ++i) {
-        Vertex vs_out;
-
-        Vec4 clip_pos = ctx->vertex_shader(&vertices[i], &vs_out, bindings);
-        float inv_w = 1.f / clip_pos.w;
-         // Perspective divide
-        clip_pos = vec4_mul(clip_pos, inv_w);
-        // Viewport to screen space
-        Vec4 screen_pos = mat44_transform_vec4(&ctx->viewport_transform, clip_pos);
-
-        Projected_Vertex v = {
-            .screen_pos = (Vec2) { screen_pos.x, screen_pos.y },
-            .inv_w = inv_w,
-            .depth = clip_pos.z,
-            // Copy vertex attributes
-            .position = vec3_mul(vs_out.position, inv_w),
-            .uv = vec2_mul(vs_out.uv, inv_w),
-            .normal = vec3_mul(vs_out.normal, inv_w),
-            .tangent = vec3_mul(vs_out.tangent, inv_w),
-        };
-        array_push(*output, v, ctx->allocator);
+    Vertex_Job job = {
+        .output = *output,
+        .varyings = *varyings,
+        .vertices = vertices,
+        .sources = sources,
+        .num_vertices = num_vertices,
+        .bindings = bindings,
+    };
+    const uint32_t num_batches = (num_vertices + VERTEX_BATCH_SIZE - 1) / VERTEX_BATCH_SIZE;
+    task_parallel_for(process_vertex_batch, &job, num_batches);
+}
+
+enum Clip_Plane {
+    // Near plane is z = 0, fragments with negative depth have always been rejected
+    CLIP_PLANE_NEAR,
+    CLIP_PLANE_FAR,
+    CLIP_PLANE_LEFT,
+    CLIP_PLANE_RIGHT,
+    CLIP_PLANE_BOTTOM,
+    CLIP_PLANE_TOP,
+    CLIP_PLANE_GUARD_LEFT,
+    CLIP_PLANE_GUARD_RIGHT,
+    CLIP_PLANE_GUARD_BOTTOM,
+    CLIP_PLANE_GUARD_TOP,
+    NUM_CLIP_PLANES,
+};
+
+#define CLIP_FRUSTUM_MASK (0x3f)
+#define CLIP_GUARD_BAND_MASK (0x3c0)
+
+// Signed distance to `plane`, negative when outside
+static inline float clip_distance(Vec4 p, enum Clip_Plane plane)
+{
+    switch (plane) {
+        case CLIP_PLANE_NEAR: return p.z;
+        case CLIP_PLANE_FAR: return p.w - p.z;
+        case CLIP_PLANE_LEFT: return p.w + p.x;
+        case CLIP_PLANE_RIGHT: return p.w - p.x;
+        case CLIP_PLANE_BOTTOM: return p.w + p.y;
+        case CLIP_PLANE_TOP: return p.w - p.y;
+        case CLIP_PLANE_GUARD_LEFT: return ctx->guard_band_x * p.w + p.x;
+        case CLIP_PLANE_GUARD_RIGHT: return ctx->guard_band_x * p.w - p.x;
+        case CLIP_PLANE_GUARD_BOTTOM: return ctx->guard_band_y * p.w + p.y;
+        case CLIP_PLANE_GUARD_TOP: return ctx->guard_band_y * p.w - p.y;
+        default: return 0;
+    }
+}
+
+static inline uint32_t clip_flags(Vec4 p)
+{
+    uint32_t flags = 0;
+    for (uint32_t i = 0; i < NUM_CLIP_PLANES; ++i) {
+        if (clip_distance(p, i) < 0)
+            flags |= 1 << i;
+    }
+    return flags;
+}
+
+// Create a vertex on the edge from `in` to `out` where it crosses `plane`
+static uint32_t clip_edge(uint32_t in, uint32_t out, enum Clip_Plane plane)
+{
+    const Projected_Vertex *a = &ctx->projected_vertices[in];
+    const Projected_Vertex *b = &ctx->projected_vertices[out];
+    const float da = clip_distance(a->clip_pos, plane);
+    const float db = clip_distance(b->clip_pos, plane);
+    const float t = da / (da - db);
+
+    Projected_Vertex v = {
+        .clip_pos = vec4_add(a->clip_pos, vec4_mul(vec4_sub(b->clip_pos, a->clip_pos), t)),
+    };
+    project_vertex(&v);
+
+    const int num_varyings = ctx->num_varyings;
+    const float *va = &ctx->varyings[in * num_varyings];
+    const float *vb = &ctx->varyings[out * num_varyings];
+    float varyings[NUM_VARYINGS];
+    for (int i = 0; i < num_varyings; ++i) {
+        varyings[i] = va[i] + (vb[i] - va[i]) * t;
+    }
+    array_join(ctx->varyings, varyings, num_varyings, ctx->allocator);
+    array_push(ctx->projected_vertices, v, ctx->allocator);
+    return (uint32_t)array_size(ctx->projected_vertices) - 1;
+}
+
+// Sutherland-Hodgman clipping of a convex polygon against a single plane
+static uint32_t clip_polygon(uint32_t *out, const uint32_t *in, uint32_t n, enum Clip_Plane plane)
+{
+    uint32_t num_out = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        const uint32_t a = in[i];
+        const uint32_t b = in[(i + 1) % n];
+        const bool a_inside = clip_distance(ctx->projected_vertices[a].clip_pos, plane) >= 0;
+        const bool b_inside = clip_distance(ctx->projected_vertices[b].clip_pos, plane) >= 0;
+        if (a_inside)
+            out[num_out++] = a;
+        // Always interpolate from the inside vertex so shared edges clip identically
+        if (a_inside && !b_inside)
+            out[num_out++] = clip_edge(a, b, plane);
+        else if (!a_inside && b_inside)
+            out[num_out++] = clip_edge(b, a, plane);
+    }
+    return num_out;
+}
+
+// Add a triangle to `ctx->triangles` unless it is culled by its facing, has no area 
+// or does not cover any pixel sample
+static void emit_triangle(uint32_t i0, uint32_t i1, uint32_t i2)
+{
+    const Fixed_Point points[3] = {
+        snap_to_subpixel(ctx->projected_vertices[i0].screen_pos),
+        snap_to_subpixel(ctx->projected_vertices[i1].screen_pos),
+        snap_to_subpixel(ctx->projected_vertices[i2].screen_pos),
+    };
+
+    // Winding is decided on the snapped positions rasterization uses
+    const int64_t area = fixed_triangle_area(points);
+    if (area == 0)
+        return;
+    if (ctx->cull_mode == CULL_MODE_BACK && area < 0)
+        return;
+    if (ctx->cull_mode == CULL_MODE_FRONT && area > 0)
+        return;
+
+    // Reject triangles falling between pixel centers or outside the screen
+    const Bounding_Box screen = { 0, 0, ctx->width - 1, ctx->height - 1 };
+    const Bounding_Box bb = triangle_bounds(points, screen);
+    if (bb.x1 < bb.x0 || bb.y1 < bb.y0)
+        return;
+
+    Triangle tri = { { i0, i1, i2 } };
+    array_push(ctx->triangles, tri, ctx->allocator);
+}
+
+// Cull triangles outside the frustum and clip the ones crossing the near plane or 
+// the guard band, appending the results to `ctx->triangles`
+static void clip_triangle(uint32_t i0, uint32_t i1, uint32_t i2)
+{
+    const uint32_t f0 = clip_flags(ctx->projected_vertices[i0].clip_pos);
+    const uint32_t f1 = clip_flags(ctx->projected_vertices[i1].clip_pos);
+    const uint32_t f2 = clip_flags(ctx->projected_vertices[i2].clip_pos);
+
+    // Every vertex outside of the same frustum plane
+    if (f0 & f1 & f2 & CLIP_FRUSTUM_MASK)
+        return;
+
+    const uint32_t clip_mask = (f0 | f1 | f2) & ((1 << CLIP_PLANE_NEAR) | CLIP_GUARD_BAND_MASK);
+    if (clip_mask == 0) {
+        emit_triangle(i0, i1, i2);
+        return;
+    }
+
+    // Each plane adds at most one vertex to the polygon
+    uint32_t polygon[2][3 + NUM_CLIP_PLANES] = { { i0, i1, i2 } };
+    uint32_t n = 3;
+    uint32_t cur = 0;
+    for (uint32_t plane = 0; plane < NUM_CLIP_PLANES && n >= 3; ++plane) {
+        if (clip_mask & (1 << plane)) {
+            n = clip_polygon(polygon[cur ^ 1], polygon[cur], n, plane);
+            cur ^= 1;
+        }
+    }
+
+    for (uint32_t i = 1; i + 1 < n; ++i) {
+        emit_triangle(polygon[cur][0], polygon[cur][i], polygon[cur][i + 1]);
+    }
+}
+
+typedef struct Raster_Job {
+    const Shader_Bindings *bindings;
+} Raster_Job;
+
+static void rasterize_tile(void *user_data, uint32_t tile_index)
+{
+    const Raster_Job *job = user_data;
+    Tile *tile = &ctx->tiles[tile_index];
+    const bool deferred = ctx->render_mode == RENDER_MODE_DEFERRED;
+    if (deferred) {
+        const Bounding_Box bb = tile->bounds;
+        for (int y = bb.y0; y <= bb.y1; ++y) {
+            uint32_t *vis_row = ctx->vis_buf + tile_row_offset(bb.x0, y);
+            for (int x = bb.x0; x <= bb.x1; ++x) {
+                vis_row[x] = NO_TRIANGLE;
+            }
+        }
+    }
+
+    const Raster_Pass pass = deferred ? RASTER_PASS_VISIBILITY 
+        : ctx->render_mode == RENDER_MODE_DEPTH_PREPASS ? RASTER_PASS_DEPTH 
+        : RASTER_PASS_SHADE;
+    for (const uint32_t *it = tile->triangles; it != array_end(tile->triangles); ++it) {
+        Triangle_Setup ts;
+        if (setup_triangle(&ts, &ctx->triangles[*it], tile->bounds))
+            rasterize_triangle(tile, &ts, *it, pass, job->bindings);
+    }
+
+    if (deferred)
+        shade_visibility(tile, job->bindings);
+
+    // Rasterize again now that the depth buffer holds the nearest surfaces, setup
+    // yields the exact same depth values so only visible fragments pass
+    if (pass == RASTER_PASS_DEPTH) {
+        for (const uint32_t *it = tile->triangles; it != array_end(tile->triangles); ++it) {
+            Triangle_Setup ts;
+            if (setup_triangle(&ts, &ctx->triangles[*it], tile->bounds))
+                rasterize_triangle(tile, &ts, *it, RASTER_PASS_SHADE_EQUAL, job->bindings);
+        }
     }
 }
 
@@ -277,45 +1264,129 @@ static void draw_triangles(gfx_id vbuf, gfx_id ibuf, uint32_t first, uint32_t co
     const Shader_Bindings bindings = { 
         .uniform_blocks = ctx->uniform_bindings,
         .textures = ctx->texture_bindings,
+        .samplers = ctx->sampler_bindings,
     };
 
-    // We only need to run the vertex transformation stage on the raw vertex data
-    // This is to avoid running potentially duplicate indexed vertices
-    uint32_t num_vertices = (uint32_t)vbuffer->size / sizeof(Vertex);
-    process_vertices(&ctx->projected_vertices, vbuffer->data, num_vertices, &bindings);
+    // Only vertices referenced by the drawn indices are transformed, each of them once.
+    // The cache maps vertex buffer indices to their projected vertex, entries from 
+    // previous draws are invalidated by bumping the generation.
+    const uint32_t num_buffer_vertices = (uint32_t)(vbuffer->size / sizeof(Vertex));
+    if (array_size(ctx->vertex_cache) < num_buffer_vertices) {
+        const Vertex_Cache_Entry empty = { 0 };
+        array_ensure(ctx->vertex_cache, num_buffer_vertices, ctx->allocator);
+        while (array_size(ctx->vertex_cache) < num_buffer_vertices) {
+            array_push(ctx->vertex_cache, empty, ctx->allocator);
+        }
+    }
+    if (++ctx->vertex_cache_generation == 0) {
+        for (Vertex_Cache_Entry *it = ctx->vertex_cache; it != array_end(ctx->vertex_cache); ++it) {
+            it->generation = 0;
+        }
+        ctx->vertex_cache_generation = 1;
+    }
+
+    const uint32_t generation = ctx->vertex_cache_generation;
+    const uint32_t *indices = (const uint32_t *)ibuffer->data + first;
+    array_reset(ctx->vertex_sources);
+    for (uint32_t i = 0; i < count; ++i) {
+        Vertex_Cache_Entry *entry = &ctx->vertex_cache[indices[i]];
+        if (entry->generation != generation) {
+            entry->generation = generation;
+            entry->index = (uint32_t)array_size(ctx->vertex_sources);
+            array_push(ctx->vertex_sources, indices[i], ctx->allocator);
+        }
+    }
+    process_vertices(&ctx->projected_vertices, &ctx->varyings, vbuffer->data, 
+        ctx->vertex_sources, (uint32_t)array_size(ctx->vertex_sources), &bindings);
     
     // Use the indices to construct the triangles to be rasterized
-    const uint32_t *indices = ibuffer->data;
-    for (uint32_t i = first; i < count; i += 3) {
-        rasterize_triangle(
-            ctx->projected_vertices[indices[i + 0]],
-            ctx->projected_vertices[indices[i + 1]],
-            ctx->projected_vertices[indices[i + 2]],
-            &bindings
-        );
+    const uint32_t num_triangles = count / 3;
+    ctx->stats.num_triangles += num_triangles;
+    array_reset(ctx->triangles);
+    for (uint32_t i = 0; i < num_triangles * 3; i += 3) {
+        clip_triangle(ctx->vertex_cache[indices[i + 0]].index, 
+            ctx->vertex_cache[indices[i + 1]].index, ctx->vertex_cache[indices[i + 2]].index);
+    }
+
+    // Bin the triangles into every tile their bounding box overlaps
+    const Bounding_Box screen = { 0, 0, ctx->width - 1, ctx->height - 1 };
+    for (Tile *it = ctx->tiles; it != array_end(ctx->tiles); ++it) {
+        array_reset(it->triangles);
+    }
+    for (uint32_t i = 0; i < array_size(ctx->triangles); ++i) {
+        const Triangle *tri = &ctx->triangles[i];
+        const Fixed_Point points[3] = {
+            snap_to_subpixel(ctx->projected_vertices[tri->v[0]].screen_pos),
+            snap_to_subpixel(ctx->projected_vertices[tri->v[1]].screen_pos),
+            snap_to_subpixel(ctx->projected_vertices[tri->v[2]].screen_pos),
+        };
+        const Bounding_Box bb = triangle_bounds(points, screen);
+        if (bb.x1 < bb.x0 || bb.y1 < bb.y0)
+            continue;
+
+        for (int ty = bb.y0 / TILE_SIZE; ty <= bb.y1 / TILE_SIZE; ++ty) {
+            for (int tx = bb.x0 / TILE_SIZE; tx <= bb.x1 / TILE_SIZE; ++tx) {
+                Tile *tile = &ctx->tiles[tx + ty * ctx->num_tiles_x];
+                array_push(tile->triangles, i, ctx->allocator);
+            }
+        }
+    }
+
+    // Each tile owns its region of the color and depth buffers, so tiles can be 
+    // rasterized in parallel while triangles within a tile keep submission order
+    Raster_Job job = {
+        .bindings = &bindings,
+    };
+    task_parallel_for(rasterize_tile, &job, (uint32_t)array_size(ctx->tiles));
+
+    for (Tile *it = ctx->tiles; it != array_end(ctx->tiles); ++it) {
+        ctx->stats.num_pixels_shaded += it->num_pixels_shaded;
+        it->num_pixels_shaded = 0;
     }
 }
 
 static void swap_buffers(uint32_t *buffer)
 {
-    const int count = ctx->width * ctx->height;
-    memcpy(buffer, ctx->color_buf, count * sizeof(*ctx->color_buf));
+    // Detile into the linear output, tiles in the last column may be partial
+    for (int y = 0; y < ctx->height; ++y) {
+        for (int x = 0; x < ctx->width; x += TILE_SIZE) {
+            const int count = c_min(TILE_SIZE, ctx->width - x);
+            memcpy(buffer + y * ctx->width + x, ctx->color_buf + tile_row_offset(x, y) + x, count * sizeof(*ctx->color_buf));
+        }
+    }
 
+    const int count = ctx->num_tiles_x * ctx->num_tiles_y * TILE_PIXELS;
     for (int i = 0; i < count; ++i) {
         ctx->color_buf[i] = 0x11111111;
         ctx->depth_buf[i] = FLT_MAX;
     }
+    for (int i = 0; i < ctx->hiz_stride * ctx->hiz_height; ++i) {
+        ctx->hiz_buf[i] = FLT_MAX;
+    }
+    ctx->stats = (Gfx_Stats) { 0 };
+}
+
+static void get_stats(Gfx_Stats *stats)
+{
+    *stats = ctx->stats;
 }
 
 struct gfx_api *gfx_api = &(struct gfx_api) {
     .init = init,
     .shutdown = shutdown,
     .bind_shaders = bind_shaders,
+    .bind_batch_vertex_shader = bind_batch_vertex_shader,
+    .bind_quad_shader = bind_quad_shader,
+    .bind_depth_shader = bind_depth_shader,
+    .set_cull_mode = set_cull_mode,
+    .set_render_mode = set_render_mode,
     .bind_uniform_block = bind_uniform_block,
     .bind_texture = bind_texture,
+    .bind_sampler = bind_sampler,
     .create_texture = create_texture,
     .create_buffer = create_buffer,
     .update_buffer = update_buffer,
     .draw_triangles = draw_triangles,
     .swap_buffers = swap_buffers,
+    .get_stats = get_stats,
 };
\ No newline at end of file
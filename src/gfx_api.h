@@ -3,14 +3,89 @@
 
 #define MAX_NUM_UNIFORM_BLOCKS (4)
 #define MAX_NUM_TEXTURES (4)
+// Enough mip levels for textures up to 32768 texels on a side
+#define MAX_NUM_TEXTURE_LEVELS (16)
 
+// Texels are stored in 4x4 blocks so that neighbours in both directions share cache lines,
+// blocks and the texels within them are in row order
+#define TEXTURE_BLOCK_SIZE (4)
+#define TEXTURE_BLOCK_TEXELS (TEXTURE_BLOCK_SIZE * TEXTURE_BLOCK_SIZE)
+
+typedef enum Texture_Format {
+    TEXTURE_FORMAT_R8,
+    TEXTURE_FORMAT_RG8,
+    TEXTURE_FORMAT_RGB8,
+    TEXTURE_FORMAT_RGBA8,
+    // 8 bytes per 4x4 block, two RGB565 endpoints with optional 1 bit alpha
+    TEXTURE_FORMAT_BC1,
+    // 16 bytes per 4x4 block, interpolated alpha followed by a BC1 color block
+    TEXTURE_FORMAT_BC3,
+} Texture_Format;
+
+typedef struct Texture_Level {
+    int width;
+    int height;
+    // Number of blocks in a row of blocks, partial blocks at the edges are padded
+    int blocks_x;
+    union {
+        uint32_t *texels;
+        // Compressed blocks of block compressed formats
+        uint8_t *blocks;
+    };
+} Texture_Level;
+
+// Texels of uncompressed formats are expanded to 32 bit RGBA, red in the lowest byte.
+// Block compressed formats keep their blocks and are decoded when sampled.
 typedef struct Texture {
     int width;
     int height;
-    int channels;
-    uint8_t *data;
+    Texture_Format format;
+    // Both sizes are powers of two, so wrapping texel coordinates is a bit mask
+    bool power_of_two;
+    // Mip chain down to 1x1, every level halves the size of the previous one. Level 0
+    // is the full image, all levels share one allocation starting at `data`.
+    int num_levels;
+    Texture_Level levels[MAX_NUM_TEXTURE_LEVELS];
+    uint64_t size;
+    void *data;
 } Texture;
 
+// Index of texel (`x`, `y`) in the block layout of `level`
+static inline int texel_index(const Texture_Level *level, int x, int y)
+{
+    const int block = (x / TEXTURE_BLOCK_SIZE) + (y / TEXTURE_BLOCK_SIZE) * level->blocks_x;
+    return block * TEXTURE_BLOCK_TEXELS + (x % TEXTURE_BLOCK_SIZE) + (y % TEXTURE_BLOCK_SIZE) * TEXTURE_BLOCK_SIZE;
+}
+
+// Size of a compressed block, 0 for formats stored as texels
+static inline int texture_block_bytes(Texture_Format format)
+{
+    switch (format) {
+    case TEXTURE_FORMAT_BC1: return 8;
+    case TEXTURE_FORMAT_BC3: return 16;
+    default: return 0;
+    }
+}
+
+typedef enum Filter_Mode {
+    // The texel containing the sample
+    FILTER_MODE_NEAREST,
+    // The 2x2 texels around the sample blended by distance
+    FILTER_MODE_LINEAR,
+} Filter_Mode;
+
+// How texel coordinates outside the texture are brought back inside
+typedef enum Address_Mode {
+    ADDRESS_MODE_WRAP,
+    ADDRESS_MODE_CLAMP,
+} Address_Mode;
+
+// How a shader samples the texture bound to the same slot
+typedef struct Sampler {
+    Filter_Mode filter;
+    Address_Mode address;
+} Sampler;
+
 typedef struct Vertex {
     Vec3 position;
     Vec2 uv;
@@ -26,17 +101,116 @@ typedef struct Buffer {
 typedef struct Shader_Bindings {
     const void **uniform_blocks;
     const Texture **textures;
+    const Sampler *samplers;
 } Shader_Bindings;
 
+// Vertex shader outputs read by a pixel shader, the others are neither stored nor interpolated
+typedef enum Varying_Flags {
+    VARYING_POSITION = 1 << 0,
+    VARYING_UV = 1 << 1,
+    VARYING_NORMAL = 1 << 2,
+    VARYING_TANGENT = 1 << 3,
+    VARYING_ALL = 0xf,
+} Varying_Flags;
+
+// Which triangles are discarded based on their winding in screen space,
+// front facing triangles are clockwise like in Direct3D
+typedef enum Cull_Mode {
+    CULL_MODE_NONE,
+    CULL_MODE_BACK,
+    CULL_MODE_FRONT,
+} Cull_Mode;
+
+typedef enum Render_Mode {
+    // Shade fragments as soon as they pass the depth test
+    RENDER_MODE_FORWARD,
+    // Rasterize depth and triangle indices into a visibility buffer first, then
+    // shade every visible pixel exactly once at the end of the draw call
+    RENDER_MODE_DEFERRED,
+    // Rasterize depth only first, then rasterize again shading fragments with equal depth
+    RENDER_MODE_DEPTH_PREPASS,
+} Render_Mode;
+
+typedef struct Gfx_Stats {
+    uint64_t num_triangles;
+    uint64_t num_pixels_shaded;
+} Gfx_Stats;
+
 typedef Vec4 (*Vertex_Shader)(const Vertex *in, Vertex *out, const Shader_Bindings *bindings);
+
+// Number of vertices transformed by one call of a `Batch_Vertex_Shader`
+#define VERTEX_SHADER_BATCH_WIDTH (8)
+
+typedef struct Vec2_Batch {
+    float x[VERTEX_SHADER_BATCH_WIDTH];
+    float y[VERTEX_SHADER_BATCH_WIDTH];
+} Vec2_Batch;
+
+typedef struct Vec3_Batch {
+    float x[VERTEX_SHADER_BATCH_WIDTH];
+    float y[VERTEX_SHADER_BATCH_WIDTH];
+    float z[VERTEX_SHADER_BATCH_WIDTH];
+} Vec3_Batch;
+
+typedef struct Vec4_Batch {
+    float x[VERTEX_SHADER_BATCH_WIDTH];
+    float y[VERTEX_SHADER_BATCH_WIDTH];
+    float z[VERTEX_SHADER_BATCH_WIDTH];
+    float w[VERTEX_SHADER_BATCH_WIDTH];
+} Vec4_Batch;
+
+// Structure of arrays view of `VERTEX_SHADER_BATCH_WIDTH` vertices, members in the same
+// order as `Vertex`
+typedef struct Vertex_Batch {
+    Vec3_Batch position;
+    Vec2_Batch uv;
+    Vec3_Batch normal;
+    Vec3_Batch tangent;
+} Vertex_Batch;
+
+// Transforms a full batch of vertices, writing their clip space positions to `clip_pos`.
+// Partial batches are padded by repeating the last vertex.
+typedef void (*Batch_Vertex_Shader)(const Vertex_Batch *in, Vertex_Batch *out, Vec4_Batch *clip_pos, const Shader_Bindings *bindings);
 typedef Vec3 (*Pixel_Shader)(const Vertex *in, const Shader_Bindings *bindings);
 
+// 2x2 pixels shaded together, ordered top-left, top-right, bottom-left, bottom-right.
+// Every pixel holds interpolated varyings, also uncovered ones, so differences between
+// neighbours give screen space derivatives.
+typedef struct Pixel_Quad {
+    Vertex in[4];
+    // Bit `i` is set if pixel `i` is covered and its output color is used
+    uint32_t mask;
+} Pixel_Quad;
+
+// Writes the colors of the four pixels of `quad` to `out`
+typedef void (*Quad_Shader)(const Pixel_Quad *quad, Vec3 *out, const Shader_Bindings *bindings);
+// Returns the depth of a fragment given its interpolated screen space `depth`
+typedef float (*Depth_Shader)(const Vertex *in, float depth, const Shader_Bindings *bindings);
+
 struct gfx_api {
     void (*init)(int width, int height);
     void (*shutdown)();
 
-    // Set active shaders
-    void (*bind_shaders)(Vertex_Shader vs, Pixel_Shader ps);
+    // Set active shaders, `varyings` is the set of `Varying_Flags` read by `ps`
+    void (*bind_shaders)(Vertex_Shader vs, Pixel_Shader ps, uint32_t varyings);
+
+    // Set a shader transforming batches of vertices in place of the vertex shader. Pass 0 
+    // to go back to transforming single vertices, the default.
+    void (*bind_batch_vertex_shader)(Batch_Vertex_Shader vs);
+
+    // Set a shader running on 2x2 pixel quads in place of the pixel shader, it reads the
+    // same varyings. Pass 0 to go back to shading single pixels, the default.
+    void (*bind_quad_shader)(Quad_Shader qs);
+
+    // Set a shader modifying fragment depth, which moves the depth test after attribute
+    // interpolation (late-Z). Pass 0 to restore early depth testing, the default.
+    void (*bind_depth_shader)(Depth_Shader ds);
+
+    // Set which triangle facing to discard, defaults to `CULL_MODE_NONE`
+    void (*set_cull_mode)(Cull_Mode mode);
+
+    // Set how draw calls are shaded, defaults to `RENDER_MODE_FORWARD`
+    void (*set_render_mode)(Render_Mode mode);
 
     // Bind a uniform block to the given `slot`
     void (*bind_uniform_block)(uint32_t slot, gfx_id id);
@@ -44,8 +218,14 @@ struct gfx_api {
     // Bind a texture to the given `slot`
     void (*bind_texture)(uint32_t slot, gfx_id id);
 
-    // Create a texture and return a handle
-    gfx_id (*create_texture)(const void *data, int width, int height, int channels);
+    // Set how the texture in the given `slot` is sampled, defaults to nearest filtering
+    // with wrapping
+    void (*bind_sampler)(uint32_t slot, Sampler sampler);
+
+    // Create a texture along with its mip chain and return a handle. `data` holds rows of
+    // `format` texels, or for block compressed formats the blocks of every mip level down
+    // to 1x1, one level after the other.
+    gfx_id (*create_texture)(const void *data, int width, int height, Texture_Format format);
     
     // Create a persistent buffer and return a handle
     gfx_id (*create_buffer)(const void *data, uint64_t size);
@@ -53,11 +233,14 @@ struct gfx_api {
     // Update buffer with `data` of given `size`
     void (*update_buffer)(gfx_id id, const void *data, uint64_t size, uint64_t offset);
 
-    // Draw triangles using vertex and index buffers
+    // Draw triangles from `count` indices starting at index `first` of the index buffer
     void (*draw_triangles)(gfx_id vbuf, gfx_id ibuf, uint32_t first, uint32_t count);
 
     // Copy internal color buffer to `buffer`
     void (*swap_buffers)(uint32_t *buffer);
+
+    // Retrieve counters accumulated since the last `swap_buffers`
+    void (*get_stats)(Gfx_Stats *stats);
 };
 
 extern struct gfx_api *gfx_api;
\ No newline at end of file
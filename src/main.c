@@ -1,6 +1,8 @@
 #pragma once
 #include "foundation/basic.h"
 #include "foundation/allocator.h"
+#include "foundation/os.h"
+#include "foundation/task.h"
 #include "renderer.h"
 
 #define WIN32_LEAN_AND_MEAN
@@ -61,23 +63,6 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
     return lResult;
 }
 
-static Time_Stamp os_time_now()
-{
-    LARGE_INTEGER pc;
-    QueryPerformanceCounter(&pc);
-    Time_Stamp result;
-    result.opaque = pc.QuadPart;
-    return result;
-}
-
-static double os_time_delta(Time_Stamp to, Time_Stamp from)
-{
-    int64_t delta = to.opaque - from.opaque;
-    LARGE_INTEGER freq;
-    QueryPerformanceFrequency(&freq);
-    return (double)delta / (double)freq.QuadPart;
-}
-
 int main(int argc, char **argv)
 {
     WNDCLASSA wc = { 
@@ -92,8 +77,9 @@ int main(int argc, char **argv)
     int w = (int)(app->window_w * app->render_scale);
     int h = (int)(app->window_h * app->render_scale);
     resize_dib_section(&app->frame_buffer, w, h);
+    task_system_init(os_num_cpus() - 1);
     gfx_api->init(w, h);
-    renderer_init(&renderer, w, h);
+    renderer_init(&renderer, w, h, "data/chest.triangle_mesh");
 
     DWORD style = WS_CAPTION | WS_SYSMENU | WS_MINIMIZEBOX;
     RECT rc;
@@ -149,6 +135,7 @@ int main(int argc, char **argv)
     }
 
     gfx_api->shutdown();
+    task_system_shutdown();
 
     int64_t allocated_bytes = total_bytes_allocated();
     printf("Leaked bytes: %zi (%.2fKB)\n", allocated_bytes, allocated_bytes / 1000.f);
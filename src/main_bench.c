@@ -0,0 +1,210 @@
+#include "foundation/basic.h"
+#include "foundation/allocator.h"
+#include "foundation/os.h"
+#include "foundation/task.h"
+#include "renderer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_NUM_MESHES (8)
+#define MAX_NUM_RESOLUTIONS (8)
+
+typedef struct Resolution {
+    int width;
+    int height;
+} Resolution;
+
+struct Bench {
+    const char *meshes[MAX_NUM_MESHES];
+    uint32_t num_meshes;
+    Resolution resolutions[MAX_NUM_RESOLUTIONS];
+    uint32_t num_resolutions;
+    uint32_t num_frames;
+    uint32_t num_warmup_frames;
+    uint32_t num_threads;
+    float dt;
+    Render_Mode render_mode;
+} *bench = &(struct Bench) {
+    .num_frames = 100,
+    .num_warmup_frames = 5,
+    .dt = 1.f / 60.f,
+};
+
+typedef struct Bench_Result {
+    double min_ms;
+    double median_ms;
+    double p99_ms;
+    double triangles_per_sec;
+    double pixels_per_sec;
+    double pixels_per_frame;
+} Bench_Result;
+
+static int compare_double(const void *a, const void *b)
+{
+    const double lhs = *(const double *)a;
+    const double rhs = *(const double *)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+// Nearest-rank percentile of a sorted sample array
+static double percentile(const double *sorted, uint32_t n, double p)
+{
+    uint32_t rank = (uint32_t)(p * n + 0.5);
+    rank = c_clamp(rank, 1, n);
+    return sorted[rank - 1];
+}
+
+static bool run_benchmark(Bench_Result *result, const char *mesh_path, Resolution res)
+{
+    Allocator *a = system_allocator;
+    const int w = res.width;
+    const int h = res.height;
+    const uint64_t fb_size = (uint64_t)w * h * sizeof(uint32_t);
+    uint32_t *frame_buffer = c_alloc(a, fb_size);
+    double *frame_times = c_alloc(a, bench->num_frames * sizeof(double));
+
+    gfx_api->init(w, h);
+    Renderer renderer = { 0 };
+    renderer_init(&renderer, w, h, mesh_path);
+    gfx_api->set_render_mode(bench->render_mode);
+
+    bool ok = renderer.mesh.vbuffer != 0;
+    if (ok) {
+        // Every configuration renders the exact same sequence of frames
+        float t = 0.0f;
+        for (uint32_t i = 0; i < bench->num_warmup_frames; ++i) {
+            renderer_draw_scene(&renderer, t);
+            gfx_api->swap_buffers(frame_buffer);
+            t += bench->dt;
+        }
+
+        t = 0.0f;
+        uint64_t num_triangles = 0;
+        uint64_t num_pixels = 0;
+        double total_time = 0.0;
+        for (uint32_t i = 0; i < bench->num_frames; ++i) {
+            Time_Stamp frame_start = os_time_now();
+            renderer_draw_scene(&renderer, t);
+            Gfx_Stats stats;
+            gfx_api->get_stats(&stats);
+            gfx_api->swap_buffers(frame_buffer);
+            frame_times[i] = os_time_delta(os_time_now(), frame_start);
+
+            total_time += frame_times[i];
+            num_triangles += stats.num_triangles;
+            num_pixels += stats.num_pixels_shaded;
+            t += bench->dt;
+        }
+
+        qsort(frame_times, bench->num_frames, sizeof(double), compare_double);
+        result->min_ms = frame_times[0] * 1000.0;
+        result->median_ms = percentile(frame_times, bench->num_frames, 0.5) * 1000.0;
+        result->p99_ms = percentile(frame_times, bench->num_frames, 0.99) * 1000.0;
+        result->triangles_per_sec = num_triangles / total_time;
+        result->pixels_per_sec = num_pixels / total_time;
+        result->pixels_per_frame = (double)num_pixels / bench->num_frames;
+    }
+
+    gfx_api->shutdown();
+    c_free(a, frame_times, bench->num_frames * sizeof(double));
+    c_free(a, frame_buffer, fb_size);
+    return ok;
+}
+
+static void print_usage(const char *exe)
+{
+    printf("Usage: %s [-m mesh]... [-r WxH]... [-n frames] [-W warmup_frames] [-j threads] [-t dt] [-R forward|deferred|prepass]\n", exe);
+}
+
+static bool parse_args(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : 0;
+        if (value == 0) {
+            print_usage(argv[0]);
+            return false;
+        }
+
+        if (strcmp(arg, "-m") == 0 && bench->num_meshes < MAX_NUM_MESHES) {
+            bench->meshes[bench->num_meshes++] = value;
+        } else if (strcmp(arg, "-r") == 0 && bench->num_resolutions < MAX_NUM_RESOLUTIONS) {
+            Resolution res;
+            if (sscanf(value, "%ix%i", &res.width, &res.height) != 2 || res.width <= 0 || res.height <= 0) {
+                fprintf(stderr, "Invalid resolution '%s'\n", value);
+                return false;
+            }
+            bench->resolutions[bench->num_resolutions++] = res;
+        } else if (strcmp(arg, "-n") == 0) {
+            bench->num_frames = (uint32_t)atoi(value);
+        } else if (strcmp(arg, "-W") == 0) {
+            bench->num_warmup_frames = (uint32_t)atoi(value);
+        } else if (strcmp(arg, "-j") == 0) {
+            bench->num_threads = (uint32_t)atoi(value);
+        } else if (strcmp(arg, "-t") == 0) {
+            bench->dt = (float)atof(value);
+        } else if (strcmp(arg, "-R") == 0) {
+            if (!render_mode_from_string(&bench->render_mode, value)) {
+                fprintf(stderr, "Invalid render mode '%s'\n", value);
+                return false;
+            }
+        } else {
+            print_usage(argv[0]);
+            return false;
+        }
+        ++i;
+    }
+
+    if (bench->num_meshes == 0)
+        bench->meshes[bench->num_meshes++] = "data/chest.triangle_mesh";
+    if (bench->num_resolutions == 0) {
+        bench->resolutions[bench->num_resolutions++] = (Resolution) { 800, 600 };
+        bench->resolutions[bench->num_resolutions++] = (Resolution) { 1920, 1080 };
+    }
+    return bench->num_frames > 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (!parse_args(argc, argv))
+        return 1;
+
+    task_system_init((bench->num_threads ? bench->num_threads : os_num_cpus()) - 1);
+
+    Bench_Result results[MAX_NUM_MESHES][MAX_NUM_RESOLUTIONS];
+    bool valid[MAX_NUM_MESHES][MAX_NUM_RESOLUTIONS];
+    for (uint32_t m = 0; m < bench->num_meshes; ++m) {
+        for (uint32_t r = 0; r < bench->num_resolutions; ++r) {
+            valid[m][r] = run_benchmark(&results[m][r], bench->meshes[m], bench->resolutions[r]);
+        }
+    }
+    const uint32_t num_threads = task_system_num_threads();
+    task_system_shutdown();
+
+    printf("\n%u frames, dt=%.4f, %u threads, %s rendering\n", 
+        bench->num_frames, bench->dt, num_threads, render_mode_names[bench->render_mode]);
+    printf("%-32s %11s %10s %10s %10s %12s %12s %12s\n",
+        "mesh", "resolution", "min ms", "median ms", "p99 ms", "Mtris/s", "Mpixels/s", "pixels/frame");
+    for (uint32_t m = 0; m < bench->num_meshes; ++m) {
+        for (uint32_t r = 0; r < bench->num_resolutions; ++r) {
+            char res[32];
+            snprintf(res, sizeof(res), "%ix%i", bench->resolutions[r].width, bench->resolutions[r].height);
+            if (!valid[m][r]) {
+                printf("%-32s %11s %10s\n", bench->meshes[m], res, "failed");
+                continue;
+            }
+            const Bench_Result *it = &results[m][r];
+            printf("%-32s %11s %10.3f %10.3f %10.3f %12.3f %12.3f %12.0f\n", bench->meshes[m], res,
+                it->min_ms, it->median_ms, it->p99_ms, it->triangles_per_sec / 1e6, it->pixels_per_sec / 1e6, 
+                it->pixels_per_frame);
+        }
+    }
+
+    int64_t allocated_bytes = total_bytes_allocated();
+    if (allocated_bytes != 0)
+        printf("Leaked bytes: %lli (%.2fKB)\n", (long long)allocated_bytes, allocated_bytes / 1000.f);
+
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include "foundation/basic.h"
+#include "foundation/allocator.h"
+#include "foundation/os.h"
+#include "foundation/task.h"
+#include "renderer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct Frame_Buffer {
+    uint32_t *data;
+    int width;
+    int height;
+} Frame_Buffer;
+
+struct App {
+    int width;
+    int height;
+    uint32_t num_frames;
+    uint32_t num_threads;
+    float fixed_dt;
+    Render_Mode render_mode;
+    const char *output_path;
+    Frame_Buffer frame_buffer;
+} *app = &(struct App) {
+    .width = 800,
+    .height = 600,
+    .num_frames = 60,
+};
+
+static void create_frame_buffer(Frame_Buffer *buffer, int width, int height)
+{
+    buffer->width = width;
+    buffer->height = height;
+    buffer->data = c_alloc(system_allocator, width * height * sizeof(uint32_t));
+    memset(buffer->data, 0, width * height * sizeof(uint32_t));
+}
+
+static void destroy_frame_buffer(Frame_Buffer *buffer)
+{
+    c_free(system_allocator, buffer->data, buffer->width * buffer->height * sizeof(uint32_t));
+    buffer->data = 0;
+}
+
+// Write the frame buffer as a binary PPM image
+static bool write_frame_buffer(const Frame_Buffer *buffer, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL)
+        return false;
+
+    fprintf(f, "P6\n%i %i\n255\n", buffer->width, buffer->height);
+    for (int i = 0; i < buffer->width * buffer->height; ++i) {
+        const uint32_t c = buffer->data[i];
+        const uint8_t rgb[3] = { (uint8_t)(c >> 16), (uint8_t)(c >> 8), (uint8_t)c };
+        fwrite(rgb, 1, 3, f);
+    }
+    fclose(f);
+    return true;
+}
+
+static void print_usage(const char *exe)
+{
+    printf("Usage: %s [-w width] [-h height] [-n frames] [-j threads] [-t fixed_dt] [-R forward|deferred|prepass] [-o output.ppm]\n", exe);
+}
+
+static bool parse_args(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : 0;
+        if (value == 0) {
+            print_usage(argv[0]);
+            return false;
+        }
+
+        if (strcmp(arg, "-w") == 0)
+            app->width = atoi(value);
+        else if (strcmp(arg, "-h") == 0)
+            app->height = atoi(value);
+        else if (strcmp(arg, "-n") == 0)
+            app->num_frames = (uint32_t)atoi(value);
+        else if (strcmp(arg, "-j") == 0)
+            app->num_threads = (uint32_t)atoi(value);
+        else if (strcmp(arg, "-t") == 0)
+            app->fixed_dt = (float)atof(value);
+        else if (strcmp(arg, "-R") == 0) {
+            if (!render_mode_from_string(&app->render_mode, value)) {
+                print_usage(argv[0]);
+                return false;
+            }
+        } else if (strcmp(arg, "-o") == 0)
+            app->output_path = value;
+        else {
+            print_usage(argv[0]);
+            return false;
+        }
+        ++i;
+    }
+    return app->width > 0 && app->height > 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (!parse_args(argc, argv))
+        return 1;
+
+    Renderer renderer;
+    int w = app->width;
+    int h = app->height;
+    create_frame_buffer(&app->frame_buffer, w, h);
+    task_system_init((app->num_threads ? app->num_threads : os_num_cpus()) - 1);
+    gfx_api->init(w, h);
+    renderer_init(&renderer, w, h, "data/chest.triangle_mesh");
+    gfx_api->set_render_mode(app->render_mode);
+
+    float t = 0.0f;
+    Time_Stamp start = os_time_now();
+    Time_Stamp global_clock = start;
+
+    for (uint32_t i = 0; i < app->num_frames; ++i) {
+        Time_Stamp frame_start = os_time_now();
+        float dt = (float)os_time_delta(frame_start, global_clock);
+        global_clock = frame_start;
+
+        renderer_draw_scene(&renderer, t);
+        // A fixed time step makes the output reproducible across runs
+        t += app->fixed_dt > 0 ? app->fixed_dt : dt;
+
+        gfx_api->swap_buffers(app->frame_buffer.data);
+    }
+
+    double elapsed = os_time_delta(os_time_now(), start);
+    printf("Rendered %u frames at %ix%i (%u threads) in %.3fs (%.2f ms/frame)\n",
+        app->num_frames, w, h, task_system_num_threads(), elapsed, app->num_frames ? elapsed * 1000.0 / app->num_frames : 0.0);
+
+    if (app->output_path) {
+        if (write_frame_buffer(&app->frame_buffer, app->output_path))
+            printf("Wrote frame buffer to '%s'\n", app->output_path);
+        else
+            fprintf(stderr, "Failed to write frame buffer to '%s'\n", app->output_path);
+    }
+
+    gfx_api->shutdown();
+    task_system_shutdown();
+    destroy_frame_buffer(&app->frame_buffer);
+
+    int64_t allocated_bytes = total_bytes_allocated();
+    printf("Leaked bytes: %lli (%.2fKB)\n", (long long)allocated_bytes, allocated_bytes / 1000.f);
+
+    return 0;
+}
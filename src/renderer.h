@@ -26,25 +26,47 @@ static void projection_from_fov(Mat44 *m, float near, float far, float vertical_
     m->wz = 2.f * far * near / range;
 }
 
+static const char *render_mode_names[] = {
+    [RENDER_MODE_FORWARD] = "forward",
+    [RENDER_MODE_DEFERRED] = "deferred",
+    [RENDER_MODE_DEPTH_PREPASS] = "prepass",
+};
+
+// Parse a render mode name as given on the command line
+static bool render_mode_from_string(Render_Mode *mode, const char *str)
+{
+    for (uint32_t i = 0; i < ARRAY_COUNT(render_mode_names); ++i) {
+        if (strcmp(str, render_mode_names[i]) == 0) {
+            *mode = (Render_Mode)i;
+            return true;
+        }
+    }
+    return false;
+}
+
 static gfx_id load_texture_from_file(const char *path)
 {
     int w, h, c;
     stbi_set_flip_vertically_on_load(1);
-    uint8_t *data = stbi_load(path, &w, &h, &c, 3);
-    gfx_id id = gfx_api->create_texture(data, w, h, c);
+    uint8_t *data = stbi_load(path, &w, &h, &c, 4);
+    gfx_id id = gfx_api->create_texture(data, w, h, TEXTURE_FORMAT_RGBA8);
     stbi_image_free(data);
     printf("Loaded texture '%s' (w=%i, h=%i, c=%i)\n", path, w, h, c);
     return id;
 }
 
-static void renderer_init(Renderer *r, int w, int h)
+static void renderer_init(Renderer *r, int w, int h, const char *mesh_path)
 {
-    gfx_api->bind_shaders(default_vertex_shader, default_pixel_shader);
+    gfx_api->bind_shaders(default_vertex_shader, default_pixel_shader, VARYING_POSITION | VARYING_UV | VARYING_NORMAL);
+    gfx_api->bind_batch_vertex_shader(default_batch_vertex_shader);
+    gfx_api->bind_quad_shader(default_quad_shader);
+    gfx_api->set_cull_mode(CULL_MODE_BACK);
 
-    load_mesh_from_file(&r->mesh, "data/chest.triangle_mesh");
+    load_mesh_from_file(&r->mesh, mesh_path);
 
     gfx_id tex = load_texture_from_file("data/chest.jpg");
     gfx_api->bind_texture(0, tex);
+    gfx_api->bind_sampler(0, (Sampler) { FILTER_MODE_LINEAR, ADDRESS_MODE_WRAP });
 
     LightUniformBlock lights;
     lights.point_lights[0] = (struct PointLight) {
@@ -16,16 +16,216 @@ typedef struct LightUniformBlock {
     uint32_t num_point_lights;
 } LightUniformBlock;
 
-static Vec3 sample_texture(const Texture *texture, Vec2 uv)
+static inline Vec3 vec3_from_m128(__m128 v)
 {
-    int x = abs((int)(uv.x * texture->width) % texture->width);
-    int y = abs((int)(uv.y * texture->height) % texture->height);
-    int idx = (x + y * texture->width) * texture->channels;
-    return (Vec3) {
-        .x = texture->data[idx + 0] / 255.f,
-        .y = texture->data[idx + 1] / 255.f,
-        .z = texture->data[idx + 2] / 255.f,
-    };
+    float out[4];
+    _mm_storeu_ps(out, v);
+    return make_vec3(out[0], out[1], out[2]);
+}
+
+// RGBA channels of a texel in the lanes of a register, 0 to 255
+static inline __m128 unpack_texel(uint32_t texel)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bytes = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)texel), zero);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(bytes, zero));
+}
+
+// Blend of the RGB of two texels with integer weights, opaque
+static inline uint32_t mix_texels(uint32_t a, uint32_t b, uint32_t wa, uint32_t wb)
+{
+    uint32_t out = 0xff000000u;
+    for (int shift = 0; shift < 24; shift += 8) {
+        const uint32_t c = ((a >> shift) & 0xff) * wa + ((b >> shift) & 0xff) * wb;
+        out |= (c / (wa + wb)) << shift;
+    }
+    return out;
+}
+
+static inline uint32_t expand_rgb565(uint32_t c)
+{
+    const uint32_t r = (c >> 11) & 0x1f;
+    const uint32_t g = (c >> 5) & 0x3f;
+    const uint32_t b = c & 0x1f;
+    return (r << 3 | r >> 2) | (g << 2 | g >> 4) << 8 | (b << 3 | b >> 2) << 16;
+}
+
+// Color part of a BC1 or BC3 block, BC3 always interpolates four colors
+static void decode_bc1_block(const uint8_t *block, bool four_colors, uint32_t *texels)
+{
+    const uint32_t c0 = block[0] | block[1] << 8;
+    const uint32_t c1 = block[2] | block[3] << 8;
+    const uint32_t e0 = expand_rgb565(c0);
+    const uint32_t e1 = expand_rgb565(c1);
+    uint32_t palette[4] = { e0 | 0xff000000u, e1 | 0xff000000u };
+    if (c0 > c1 || four_colors) {
+        palette[2] = mix_texels(e0, e1, 2, 1);
+        palette[3] = mix_texels(e0, e1, 1, 2);
+    } else {
+        palette[2] = mix_texels(e0, e1, 1, 1);
+        palette[3] = 0;
+    }
+
+    const uint32_t indices = block[4] | block[5] << 8 | block[6] << 16 | (uint32_t)block[7] << 24;
+    for (int i = 0; i < TEXTURE_BLOCK_TEXELS; ++i) {
+        texels[i] = palette[(indices >> (2 * i)) & 3];
+    }
+}
+
+// Alpha part of a BC3 block, replaces the alpha of `texels`
+static void decode_bc3_alpha(const uint8_t *block, uint32_t *texels)
+{
+    const uint32_t a0 = block[0];
+    const uint32_t a1 = block[1];
+    uint32_t palette[8] = { a0, a1 };
+    if (a0 > a1) {
+        for (uint32_t i = 1; i < 7; ++i)
+            palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+    } else {
+        for (uint32_t i = 1; i < 5; ++i)
+            palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i) {
+        indices |= (uint64_t)block[2 + i] << (8 * i);
+    }
+    for (int i = 0; i < TEXTURE_BLOCK_TEXELS; ++i) {
+        texels[i] = (texels[i] & 0x00ffffffu) | palette[(indices >> (3 * i)) & 7] << 24;
+    }
+}
+
+// Number of decoded blocks kept per thread, neighbouring blocks map to different entries
+#define DECODED_BLOCK_CACHE_SIZE (64)
+
+// Entries are tagged with the block contents rather than its address, so they never
+// go stale when textures are freed or replaced
+typedef struct Decoded_Block {
+    Texture_Format format;
+    uint64_t bits[2];
+    uint32_t texels[TEXTURE_BLOCK_TEXELS];
+} Decoded_Block;
+
+static THREAD_LOCAL Decoded_Block decoded_block_cache[DECODED_BLOCK_CACHE_SIZE];
+
+static const uint32_t *decode_block(Texture_Format format, const uint8_t *block, int block_bytes)
+{
+    uint64_t bits[2] = { 0 };
+    memcpy(bits, block, block_bytes);
+    Decoded_Block *entry = &decoded_block_cache[((uintptr_t)block / block_bytes) % DECODED_BLOCK_CACHE_SIZE];
+    if (entry->format == format && entry->bits[0] == bits[0] && entry->bits[1] == bits[1])
+        return entry->texels;
+
+    entry->format = format;
+    entry->bits[0] = bits[0];
+    entry->bits[1] = bits[1];
+    if (format == TEXTURE_FORMAT_BC1) {
+        decode_bc1_block(block, false, entry->texels);
+    } else {
+        decode_bc1_block(block + 8, true, entry->texels);
+        decode_bc3_alpha(block, entry->texels);
+    }
+    return entry->texels;
+}
+
+static inline uint32_t load_texel(const Texture *texture, const Texture_Level *level, int x, int y)
+{
+    const int index = texel_index(level, x, y);
+    const int block_bytes = texture_block_bytes(texture->format);
+    if (block_bytes == 0)
+        return level->texels[index];
+
+    const uint8_t *block = level->blocks + (index / TEXTURE_BLOCK_TEXELS) * block_bytes;
+    return decode_block(texture->format, block, block_bytes)[index % TEXTURE_BLOCK_TEXELS];
+}
+
+static inline int floor_to_int(float x)
+{
+    const int i = (int)x;
+    return i - (x < (float)i);
+}
+
+// Moves texel coordinate `x` inside a level of `size` texels according to the address mode
+static inline int address_texel(const Texture *texture, const Sampler *sampler, int x, int size)
+{
+    if (sampler->address == ADDRESS_MODE_CLAMP)
+        return c_clamp(x, 0, size - 1);
+    if (texture->power_of_two)
+        return x & (size - 1);
+    x %= size;
+    return x < 0 ? x + size : x;
+}
+
+// RGBA of `uv` in `level`, 0 to 255
+static inline __m128 fetch_texel(const Texture *texture, const Sampler *sampler, const Texture_Level *level, Vec2 uv)
+{
+    if (sampler->filter == FILTER_MODE_NEAREST) {
+        const int x = address_texel(texture, sampler, floor_to_int(uv.x * level->width), level->width);
+        const int y = address_texel(texture, sampler, floor_to_int(uv.y * level->height), level->height);
+        return unpack_texel(load_texel(texture, level, x, y));
+    }
+
+    // Texel centers are at half coordinates
+    const float u = uv.x * level->width - 0.5f;
+    const float v = uv.y * level->height - 0.5f;
+    const int x = floor_to_int(u);
+    const int y = floor_to_int(v);
+    const int x0 = address_texel(texture, sampler, x, level->width);
+    const int x1 = address_texel(texture, sampler, x + 1, level->width);
+    const int y0 = address_texel(texture, sampler, y, level->height);
+    const int y1 = address_texel(texture, sampler, y + 1, level->height);
+
+    // All four texels are unpacked together, then blended horizontally and vertically
+    const __m128i quad = _mm_setr_epi32(
+        (int)load_texel(texture, level, x0, y0), (int)load_texel(texture, level, x1, y0),
+        (int)load_texel(texture, level, x0, y1), (int)load_texel(texture, level, x1, y1));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i top = _mm_unpacklo_epi8(quad, zero);
+    const __m128i bottom = _mm_unpackhi_epi8(quad, zero);
+    const __m128 t0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(top, zero));
+    const __m128 t1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(top, zero));
+    const __m128 b0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(bottom, zero));
+    const __m128 b1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(bottom, zero));
+
+    const __m128 fx = _mm_set1_ps(u - x);
+    const __m128 fy = _mm_set1_ps(v - y);
+    const __m128 t = _mm_add_ps(t0, _mm_mul_ps(_mm_sub_ps(t1, t0), fx));
+    const __m128 b = _mm_add_ps(b0, _mm_mul_ps(_mm_sub_ps(b1, b0), fx));
+    return _mm_add_ps(t, _mm_mul_ps(_mm_sub_ps(b, t), fy));
+}
+
+// Full resolution level only
+static Vec3 sample_texture(const Texture *texture, const Sampler *sampler, Vec2 uv)
+{
+    const __m128 rgba = fetch_texel(texture, sampler, &texture->levels[0], uv);
+    return vec3_from_m128(_mm_mul_ps(rgba, _mm_set1_ps(1.f / 255.f)));
+}
+
+// Mip level whose texels match the footprint of a pixel, given the uv derivatives along
+// screen x and y
+static inline float texture_lod(const Texture *texture, Vec2 ddx, Vec2 ddy)
+{
+    const Vec2 size = make_vec2((float)texture->width, (float)texture->height);
+    const Vec2 dx = vec2_element_mul(ddx, size);
+    const Vec2 dy = vec2_element_mul(ddy, size);
+    const float rho2 = c_max(vec2_dot(dx, dx), vec2_dot(dy, dy));
+    return 0.5f * log2f(c_max(rho2, 1.f));
+}
+
+// The two mip levels around `lod` blended by its fraction
+static Vec3 sample_texture_lod(const Texture *texture, const Sampler *sampler, Vec2 uv, float lod)
+{
+    lod = c_min(lod, (float)(texture->num_levels - 1));
+    const int level = (int)lod;
+    const float t = lod - level;
+    __m128 rgba = fetch_texel(texture, sampler, &texture->levels[level], uv);
+    if (t != 0.f) {
+        const __m128 next = fetch_texel(texture, sampler, &texture->levels[level + 1], uv);
+        rgba = _mm_add_ps(rgba, _mm_mul_ps(_mm_sub_ps(next, rgba), _mm_set1_ps(t)));
+    }
+    return vec3_from_m128(_mm_mul_ps(rgba, _mm_set1_ps(1.f / 255.f)));
 }
 
 static Vec4 default_vertex_shader(const Vertex *in, Vertex *out, const Shader_Bindings *bindings)
@@ -41,6 +241,47 @@ static Vec4 default_vertex_shader(const Vertex *in, Vertex *out, const Shader_Bi
     return mat44_transform_vec4(&globals->view_projection, world_pos);
 }
 
+// Rows of `m` applied to four points at once, the points have an implicit w of 1
+static inline __m128 transform_row_4(__m128 x, __m128 y, __m128 z, float mx, float my, float mz, float mw)
+{
+    const __m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(mx), x), _mm_mul_ps(_mm_set1_ps(my), y));
+    return _mm_add_ps(_mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(mz), z)), _mm_set1_ps(mw));
+}
+
+// Same as `default_vertex_shader`, four vertices per SSE register
+static void default_batch_vertex_shader(const Vertex_Batch *in, Vertex_Batch *out, Vec4_Batch *clip_pos, const Shader_Bindings *bindings)
+{
+    const GlobalUniformBlock *globals = bindings->uniform_blocks[0];
+    const Mat44 *m = &globals->transform;
+    const Mat44 *vp = &globals->view_projection;
+
+    for (int i = 0; i < VERTEX_SHADER_BATCH_WIDTH; i += 4) {
+        const __m128 px = _mm_loadu_ps(in->position.x + i);
+        const __m128 py = _mm_loadu_ps(in->position.y + i);
+        const __m128 pz = _mm_loadu_ps(in->position.z + i);
+        const __m128 wx = transform_row_4(px, py, pz, m->xx, m->yx, m->zx, m->wx);
+        const __m128 wy = transform_row_4(px, py, pz, m->xy, m->yy, m->zy, m->wy);
+        const __m128 wz = transform_row_4(px, py, pz, m->xz, m->yz, m->zz, m->wz);
+        _mm_storeu_ps(out->position.x + i, wx);
+        _mm_storeu_ps(out->position.y + i, wy);
+        _mm_storeu_ps(out->position.z + i, wz);
+
+        const __m128 nx = _mm_loadu_ps(in->normal.x + i);
+        const __m128 ny = _mm_loadu_ps(in->normal.y + i);
+        const __m128 nz = _mm_loadu_ps(in->normal.z + i);
+        _mm_storeu_ps(out->normal.x + i, transform_row_4(nx, ny, nz, m->xx, m->yx, m->zx, m->wx));
+        _mm_storeu_ps(out->normal.y + i, transform_row_4(nx, ny, nz, m->xy, m->yy, m->zy, m->wy));
+        _mm_storeu_ps(out->normal.z + i, transform_row_4(nx, ny, nz, m->xz, m->yz, m->zz, m->wz));
+
+        _mm_storeu_ps(clip_pos->x + i, transform_row_4(wx, wy, wz, vp->xx, vp->yx, vp->zx, vp->wx));
+        _mm_storeu_ps(clip_pos->y + i, transform_row_4(wx, wy, wz, vp->xy, vp->yy, vp->zy, vp->wy));
+        _mm_storeu_ps(clip_pos->z + i, transform_row_4(wx, wy, wz, vp->xz, vp->yz, vp->zz, vp->wz));
+        _mm_storeu_ps(clip_pos->w + i, transform_row_4(wx, wy, wz, vp->xw, vp->yw, vp->zw, vp->ww));
+    }
+    out->uv = in->uv;
+    out->tangent = in->tangent;
+}
+
 static inline float distance_attenuation(Vec3 unormalized_light_vec) 
 {
     float dist2 = vec3_dot(unormalized_light_vec, unormalized_light_vec);
@@ -48,9 +289,9 @@ static inline float distance_attenuation(Vec3 unormalized_light_vec)
     return att;
 }
 
-static Vec3 default_pixel_shader(const Vertex *in, const Shader_Bindings *bindings)
+// Point lights and ambient term applied to a surface of color `albedo`
+static Vec3 default_lighting(const Vertex *in, Vec3 albedo, const Shader_Bindings *bindings)
 {
-    const Texture *albedo = bindings->textures[0];
     const GlobalUniformBlock *globals = bindings->uniform_blocks[0];
     const LightUniformBlock *lights = bindings->uniform_blocks[1];
 
@@ -75,6 +316,28 @@ static Vec3 default_pixel_shader(const Vertex *in, const Shader_Bindings *bindin
     }
 
     Vec3 ambient = make_vec3(0.2f, 0.2f, 0.2f);
-    Vec3 tex_color = sample_texture(albedo, in->uv);
-    return vec3_element_mul(tex_color, vec3_add(vec3_add(ambient, diffuse_acc), specular_acc));
-}
\ No newline at end of file
+    return vec3_element_mul(albedo, vec3_add(vec3_add(ambient, diffuse_acc), specular_acc));
+}
+
+static Vec3 default_pixel_shader(const Vertex *in, const Shader_Bindings *bindings)
+{
+    const Texture *albedo = bindings->textures[0];
+    return default_lighting(in, sample_texture(albedo, &bindings->samplers[0], in->uv), bindings);
+}
+
+// Same as `default_pixel_shader`, the texture level of detail comes from the uv
+// differences between neighbouring pixels of the quad
+static void default_quad_shader(const Pixel_Quad *quad, Vec3 *out, const Shader_Bindings *bindings)
+{
+    const Texture *albedo = bindings->textures[0];
+    const Sampler *sampler = &bindings->samplers[0];
+    const Vec2 ddx = vec2_sub(quad->in[1].uv, quad->in[0].uv);
+    const Vec2 ddy = vec2_sub(quad->in[2].uv, quad->in[0].uv);
+    const float lod = texture_lod(albedo, ddx, ddy);
+    for (int i = 0; i < 4; ++i) {
+        if (quad->mask & (1 << i)) {
+            const Vec3 color = sample_texture_lod(albedo, sampler, quad->in[i].uv, lod);
+            out[i] = default_lighting(&quad->in[i], color, bindings);
+        }
+    }
+}